@@ -203,6 +203,7 @@ SOURCES += \
     src/timedata.cpp \
     src/txdb.cpp \
     src/txmempool.cpp \
+    src/utxostats.cpp \
     src/uint256.cpp \
     src/utilmoneystr.cpp \
     src/utilstrencodings.cpp \
@@ -314,7 +315,9 @@ SOURCES += \
     src/xbridge/xbridgetransactionmember.cpp \
     src/support/cleanse.cpp \
     src/crypto/chacha20.cpp \
+    src/crypto/muhash.cpp \
     src/bip38.cpp \
+    src/blockfilemap.cpp \
     src/s3downloader.cpp \
     src/coinvalidator.cpp \
     src/xbridge/xbitcoinaddress.cpp \
@@ -486,6 +489,7 @@ HEADERS += \
     src/checkqueue.h \
     src/hash.h \
     src/limitedmap.h \
+    src/lrucache.h \
     src/threadsafety.h \
     src/qt/macnotificationhandler.h \
     src/tinyformat.h \
@@ -493,6 +497,7 @@ HEADERS += \
     src/amount.h \
     src/arith_uint256.h \
     src/bip38.h \
+    src/blockfilemap.h \
     src/chain.h \
     src/chainparams.h \
     src/chainparamsbase.h \
@@ -523,6 +528,7 @@ HEADERS += \
     src/swifttx.h \
     src/timedata.h \
     src/txmempool.h \
+    src/utxostats.h \
     src/undo.h \
     src/utilmoneystr.h \
     src/utilstrencodings.h \
@@ -638,6 +644,7 @@ HEADERS += \
     src/support/cleanse.h \
     src/ptr.h \
     src/crypto/chacha20.h \
+    src/crypto/muhash.h \
     src/compat/endian.h \
     src/compat/byteswap.h \
     src/s3downloader.h \
@@ -530,10 +530,12 @@ SOURCES += src/activeservicenode.cpp \
            src/test/DoS_tests.cpp \
            src/test/getarg_tests.cpp \
            src/test/hash_tests.cpp \
+           src/test/kernel_tests.cpp \
            src/test/key_tests.cpp \
            src/test/main_tests.cpp \
            src/test/mempool_tests.cpp \
            src/test/miner_tests.cpp \
+           src/test/lrucache_tests.cpp \
            src/test/mruset_tests.cpp \
            src/test/multisig_tests.cpp \
            src/test/netbase_tests.cpp \
@@ -0,0 +1,96 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMapCache blockFileMapCache;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+CMappedBlockFile* CMappedBlockFile::Open(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    return NULL;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("mmap", "%s : mmap of %s failed\n", __func__, path.string());
+        return NULL;
+    }
+#ifdef MADV_RANDOM
+    madvise(p, nSize, MADV_RANDOM);
+#endif
+    return new CMappedBlockFile((const char*)p, nSize);
+#endif
+}
+
+void CBlockFileMapCache::SetMaxFiles(unsigned int nMaxFiles)
+{
+    LOCK(cs);
+    fEnabled = nMaxFiles > 0;
+    if (fEnabled)
+        mapFiles.max_size(nMaxFiles);
+    else
+        mapFiles.clear();
+}
+
+CMappedBlockFileRef CBlockFileMapCache::Get(int nFile, const boost::filesystem::path& path, size_t nMinSize)
+{
+    LOCK(cs);
+    if (!fEnabled)
+        return CMappedBlockFileRef();
+
+    CMappedBlockFileRef ref;
+    if (mapFiles.get(nFile, ref) && ref->size() >= nMinSize)
+        return ref;
+
+    // Not mapped yet, or the file has been appended to since it was mapped
+    ref.reset(CMappedBlockFile::Open(path));
+    if (!ref || ref->size() < nMinSize) {
+        mapFiles.erase(nFile);
+        return CMappedBlockFileRef();
+    }
+    mapFiles.insert(nFile, ref);
+    return ref;
+}
+
+void CBlockFileMapCache::Invalidate(int nFile)
+{
+    LOCK(cs);
+    mapFiles.erase(nFile);
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+}
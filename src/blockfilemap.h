@@ -0,0 +1,75 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "lrucache.h"
+#include "sync.h"
+
+#include <stddef.h>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+
+/** Default for -blockmapcache, number of blk?????.dat files kept memory mapped for reading */
+static const unsigned int DEFAULT_BLOCKFILE_MAP_CACHE = sizeof(void*) > 4 ? 8 : 0;
+
+/** Read-only memory mapping of a whole block file. Unmapped when the last reference goes away. */
+class CMappedBlockFile
+{
+private:
+    // Disallow copies
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+    const char* pdata;
+    size_t nSize;
+
+    CMappedBlockFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+
+public:
+    ~CMappedBlockFile();
+
+    /** Map path read-only; returns NULL if the platform or the file does not allow it */
+    static CMappedBlockFile* Open(const boost::filesystem::path& path);
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+typedef boost::shared_ptr<const CMappedBlockFile> CMappedBlockFileRef;
+
+/**
+ * Small cache of memory mapped block files, so repeated block reads are served
+ * straight from the page cache instead of fopen/fseek/fread per call.
+ * Files that have grown past their mapping are remapped on demand.
+ */
+class CBlockFileMapCache
+{
+private:
+    mutable CCriticalSection cs;
+    lrucache<int, CMappedBlockFileRef> mapFiles;
+    bool fEnabled;
+
+public:
+    CBlockFileMapCache() : mapFiles(DEFAULT_BLOCKFILE_MAP_CACHE), fEnabled(DEFAULT_BLOCKFILE_MAP_CACHE > 0) {}
+
+    /** Set the number of files kept mapped; 0 disables memory mapped reads */
+    void SetMaxFiles(unsigned int nMaxFiles);
+
+    /**
+     * Return a mapping of file nFile at path that covers at least nMinSize bytes,
+     * or an empty reference if the caller should fall back to stdio.
+     */
+    CMappedBlockFileRef Get(int nFile, const boost::filesystem::path& path, size_t nMinSize);
+
+    /** Drop the mapping of nFile, e.g. before the file gets truncated */
+    void Invalidate(int nFile);
+    void Clear();
+};
+
+extern CBlockFileMapCache blockFileMapCache;
+
+#endif // BITCOIN_BLOCKFILEMAP_H
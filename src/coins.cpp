@@ -40,6 +40,8 @@ bool CCoins::Spend(const COutPoint& out, CTxInUndo& undo)
         return false;
     undo = CTxInUndo(vout[out.n]);
     vout[out.n].SetNull();
+    // clear() keeps the capacity, give the script bytes back as well
+    CScript().swap(vout[out.n].scriptPubKey);
     Cleanup();
     if (vout.size() == 0) {
         undo.nHeight = nHeight;
@@ -75,7 +77,9 @@ bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false),
+                                                      cacheCoins(0, CCoinsKeyHasher(), std::equal_to<uint256>(), CCoinsMap::allocator_type(&poolCoins)),
+                                                      cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0) {}
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -85,13 +89,17 @@ CCoinsViewCache::~CCoinsViewCache()
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256& txid) const
 {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
         return it;
+    }
+    nCacheMisses++;
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
     tmp.swap(ret->second.coins);
+    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
@@ -113,8 +121,10 @@ bool CCoinsViewCache::GetCoins(const uint256& txid, CCoins& coins) const
 CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
 {
     assert(!hasModifier);
+    size_t cachedCoinUsage = 0;
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
     if (ret.second) {
+        nCacheMisses++;
         if (!base->GetCoins(txid, ret.first->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
             ret.first->second.coins.Clear();
@@ -123,10 +133,36 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
             // The parent view only has a pruned entry for this; mark it as fresh.
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
+    } else {
+        nCacheHits++;
+        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first);
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
+}
+
+bool CCoinsViewCache::HaveCoinsInCache(const uint256& txid) const
+{
+    return cacheCoins.count(txid) > 0;
+}
+
+bool CCoinsViewCache::GetCoinsFromBase(const uint256& txid, CCoins& coins) const
+{
+    return base->GetCoins(txid, coins);
+}
+
+void CCoinsViewCache::AddFetchedCoins(const uint256& txid, CCoins& coins)
+{
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return;
+    coins.swap(ret.first->second.coins);
+    cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+    if (ret.first->second.coins.IsPruned()) {
+        // Same as in FetchCoins, the parent only has an empty entry
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
 }
 
 const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
@@ -176,6 +212,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
+                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
                 }
             } else {
@@ -183,10 +220,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
+                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -202,6 +242,7 @@ bool CCoinsViewCache::Flush()
 {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    cachedCoinsUsage = 0;
     return fOk;
 }
 
@@ -210,6 +251,21 @@ unsigned int CCoinsViewCache::GetCacheSize() const
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::DynamicMemoryUsage() const
+{
+    return poolCoins.BytesAllocated() + memusage::MallocUsage(sizeof(void*) * (cacheCoins.bucket_count() + 1)) + cachedCoinsUsage;
+}
+
+void CCoinsViewCache::GetCacheStats(CCoinsCacheStats& stats) const
+{
+    stats.nEntries = cacheCoins.size();
+    stats.nDynamicUsage = DynamicMemoryUsage();
+    stats.nPoolBytes = poolCoins.BytesAllocated();
+    stats.nCoinsBytes = cachedCoinsUsage;
+    stats.nHits = nCacheHits;
+    stats.nMisses = nCacheMisses;
+}
+
 const CTxOut& CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -259,7 +315,7 @@ double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight) const
     return tx.ComputePriority(dResult);
 }
 
-CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_) : cache(cache_), it(it_)
+CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage)
 {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
@@ -270,7 +326,11 @@ CCoinsModifier::~CCoinsModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
     it->second.coins.Cleanup();
+    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
+    } else {
+        // If the coin still exists after the modification, add the new usage
+        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
     }
 }
@@ -7,12 +7,15 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "memusage.h"
+#include "poolallocator.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
 #include "undo.h"
 
 #include <assert.h>
+#include <functional>
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
@@ -143,6 +146,15 @@ public:
         std::swap(to.nVersion, nVersion);
     }
 
+    //! heap memory owned by this object: the output vector and each output's script
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        BOOST_FOREACH (const CTxOut& out, vout)
+            ret += memusage::MallocUsage(out.scriptPubKey.capacity());
+        return ret;
+    }
+
     //! equality test
     friend bool operator==(const CCoins& a, const CCoins& b)
     {
@@ -316,7 +328,20 @@ struct CCoinsCacheEntry {
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher, std::equal_to<uint256>,
+    pool_allocator<std::pair<const uint256, CCoinsCacheEntry> > > CCoinsMap;
+
+/** Memory and hit rate figures of a CCoinsViewCache */
+struct CCoinsCacheStats {
+    size_t nEntries;
+    size_t nDynamicUsage; //!< everything below together with the hash table buckets
+    size_t nPoolBytes;    //!< arena holding the cache entries
+    size_t nCoinsBytes;   //!< output vectors and scripts owned by the entries
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    CCoinsCacheStats() : nEntries(0), nDynamicUsage(0), nPoolBytes(0), nCoinsBytes(0), nHits(0), nMisses(0) {}
+};
 
 struct CCoinsStats {
     int nHeight;
@@ -398,7 +423,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -414,6 +440,9 @@ protected:
     /* Whether this cache has an active modifier. */
     bool hasModifier;
 
+    //! Arena for the nodes of cacheCoins, must be declared (and so outlive) it
+    CObjectPool poolCoins;
+
     /**
      * Make mutable so that we can "fill the cache" even from Get-methods
      * declared as "const".  
@@ -421,6 +450,13 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    //! Heap memory owned by the CCoins objects in cacheCoins
+    mutable size_t cachedCoinsUsage;
+
+    //! Lookups answered from the cache and lookups that had to ask the base view
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -446,6 +482,22 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256& txid);
 
+    //! Check whether txid is in this cache, without reading it from the base view
+    bool HaveCoinsInCache(const uint256& txid) const;
+
+    /**
+     * Read txid straight from the base view, leaving this cache untouched. Several
+     * threads may call this at once if the base view supports concurrent reads
+     * (like CCoinsViewDB) and nothing modifies this cache meanwhile.
+     */
+    bool GetCoinsFromBase(const uint256& txid, CCoins& coins) const;
+
+    /**
+     * Insert coins obtained with GetCoinsFromBase into the cache, as if they had been
+     * fetched on demand. Does nothing if the cache already has an entry for txid.
+     */
+    void AddFetchedCoins(const uint256& txid, CCoins& coins);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -456,6 +508,11 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the heap memory used by the cache, in bytes
+    size_t DynamicMemoryUsage() const;
+
+    void GetCacheStats(CCoinsCacheStats& stats) const;
+
     /** 
      * Amount of blocknetdx coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,178 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+namespace
+{
+/** 2^3072 - MAX_PRIME_DIFF is the largest prime below 2^3072 */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+}
+
+void Num3072::SetOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= 0xFFFFFFFFu - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != 0xFFFFFFFFu)
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is adding MAX_PRIME_DIFF and dropping 2^3072
+    uint64_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t cur = (uint64_t)limbs[i] + carry;
+        limbs[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint32_t t[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            uint64_t cur = (uint64_t)limbs[i] * a.limbs[j] + t[i + j] + carry;
+            t[i + j] = (uint32_t)cur;
+            carry = cur >> 32;
+        }
+        t[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // The high half is worth MAX_PRIME_DIFF times itself in the low half, since 2^3072 = MAX_PRIME_DIFF (mod p)
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t cur = (uint64_t)t[i] + (uint64_t)t[i + LIMBS] * MAX_PRIME_DIFF + carry;
+        limbs[i] = (uint32_t)cur;
+        carry = cur >> 32;
+    }
+    while (carry) {
+        uint64_t add = carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && add; i++) {
+            uint64_t cur = (uint64_t)limbs[i] + (add & 0xFFFFFFFFu);
+            limbs[i] = (uint32_t)cur;
+            add = (add >> 32) + (cur >> 32);
+        }
+        carry = add;
+    }
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p - 2) with a fixed 4-bit window over the exponent
+    Num3072 table[16];
+    for (int i = 1; i < 16; i++) {
+        table[i] = table[i - 1];
+        table[i].Multiply(*this);
+    }
+
+    Num3072 r;
+    for (int i = LIMBS * 8 - 1; i >= 0; i--) {
+        uint32_t nLimb = i / 8 == 0 ? 0xFFFFFFFFu - MAX_PRIME_DIFF - 1 : 0xFFFFFFFFu;
+        uint32_t nNibble = (nLimb >> (4 * (i % 8))) & 0xF;
+        if (i != LIMBS * 8 - 1) {
+            for (int j = 0; j < 4; j++)
+                r.Multiply(r);
+        }
+        if (nNibble)
+            r.Multiply(table[nNibble]);
+    }
+    return r;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+bool Num3072::operator==(const Num3072& a) const
+{
+    for (int i = 0; i < LIMBS; i++) {
+        if (limbs[i] != a.limbs[i])
+            return false;
+    }
+    return true;
+}
+
+void Num3072::FromBytes(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; i++)
+        limbs[i] = ReadLE32(data + 4 * i);
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    for (int i = 0; i < LIMBS; i++)
+        WriteLE32(out + 4 * i, limbs[i]);
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(expanded, sizeof(expanded));
+    Num3072 num;
+    num.FromBytes(expanded);
+    return num;
+}
+
+void MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+}
+
+void MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& other)
+{
+    numerator.Multiply(other.numerator);
+    denominator.Multiply(other.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& other)
+{
+    numerator.Multiply(other.denominator);
+    denominator.Multiply(other.numerator);
+    return *this;
+}
+
+bool MuHash3072::operator==(const MuHash3072& other) const
+{
+    Num3072 a = numerator, b = other.numerator;
+    a.Multiply(other.denominator);
+    b.Multiply(denominator);
+    return a == b;
+}
+
+void MuHash3072::Finalize(unsigned char out[32]) const
+{
+    Num3072 r = numerator;
+    r.Divide(denominator);
+    unsigned char data[Num3072::BYTE_SIZE];
+    r.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Unsigned integer modulo the prime 2^3072 - 1103717, little endian 32-bit limbs */
+class Num3072
+{
+public:
+    static const int LIMBS = 96;
+    static const int BYTE_SIZE = LIMBS * 4;
+
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetOne(); }
+
+    void SetOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    bool operator==(const Num3072& a) const;
+
+    void FromBytes(const unsigned char* data);
+    void ToBytes(unsigned char* out) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * Multiset hash after Bellare and Micciancio's MuHash. Every element is
+ * expanded to a number modulo a 3072-bit prime and multiplied into the set's
+ * value, so elements can be added and removed in any order, and hashes of
+ * disjoint sets combine by multiplication. Removals are collected in a
+ * separate denominator so the costly inverse is only taken by Finalize.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const int SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    /** Hash of the empty set */
+    MuHash3072() {}
+
+    void Insert(const unsigned char* data, size_t len);
+    void Remove(const unsigned char* data, size_t len);
+
+    /** Union with, or difference from, the set hashed by other */
+    MuHash3072& operator*=(const MuHash3072& other);
+    MuHash3072& operator/=(const MuHash3072& other);
+
+    /** Whether both hash the same set, without finalizing either */
+    bool operator==(const MuHash3072& other) const;
+    bool operator!=(const MuHash3072& other) const { return !(*this == other); }
+
+    /** 32-byte digest of the set */
+    void Finalize(unsigned char out[32]) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char data[SERIALIZED_SIZE];
+        numerator.ToBytes(data);
+        denominator.ToBytes(data + Num3072::BYTE_SIZE);
+        s.write((const char*)data, sizeof(data));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char data[SERIALIZED_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator.FromBytes(data);
+        denominator.FromBytes(data + Num3072::BYTE_SIZE);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const { return SERIALIZED_SIZE; }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
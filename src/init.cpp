@@ -15,6 +15,7 @@
 #include "activeservicenode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilemap.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "key.h"
@@ -32,6 +33,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 #include "xbridge/xbridgeapp.h"
 #include "coinvalidator.h"
@@ -59,6 +61,7 @@
 
 #if ENABLE_ZMQ
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
 #endif
 
 using namespace boost;
@@ -157,7 +160,7 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -211,6 +214,7 @@ void PrepareShutdown()
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
         }
+        utxoStatsTracker.Stop();
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -219,6 +223,7 @@ void PrepareShutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        blockFileMapCache.Clear();
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -322,6 +327,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-blockmapcache=<n>", strprintf(_("Keep at most <n> block files memory mapped for reading blocks (0 = use stdio, default: %u)"), DEFAULT_BLOCKFILE_MAP_CACHE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
@@ -334,7 +340,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes of transactions (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "blocknetdxd.pid"));
@@ -343,6 +351,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt("-txcachesize=<n>", strprintf(_("Keep at most <n> recently looked up confirmed transactions in memory (0 = disable, default: %u)"), DEFAULT_TX_CACHE_SIZE));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 1));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
@@ -414,14 +423,29 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via SwiftTX) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubxborder=<address>", _("Enable publish xbridge orders as they are posted in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubxbstate=<address>", _("Enable publish xbridge order state changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhwm=<n>", strprintf(_("Set the ZMQ send high water mark of publish sockets (default: %d)"), DEFAULT_ZMQ_PUB_HWM));
+    strUsage += HelpMessageOpt("-zmqpubqueue=<n>", strprintf(_("Queue at most <n> notifications for publishing, further ones are dropped (default: %u)"), DEFAULT_ZMQ_PUB_QUEUE));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-utxostatscheck=<n>", strprintf("Verify the UTXO set statistics kept for gettxoutsetinfo with a background scan every <n> blocks (0 = never, default: %d)", DEFAULT_UTXOSTATS_CHECK_INTERVAL));
         strUsage += HelpMessageOpt("-checkpoints", strprintf(_("Only accept block chain matching built-in checkpoints (default: %u)"), 1));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), 100));
+        strUsage += HelpMessageOpt("-chainstatemaxopenfiles=<n>", strprintf("Number of table files the chainstate database keeps open (default: %d)", DEFAULT_CHAINSTATE_MAX_OPEN_FILES));
+        strUsage += HelpMessageOpt("-chainstateblocksize=<n>", strprintf("Size of chainstate database table blocks in kilobytes (default: %u)", CLevelDBOptions().nBlockSize >> 10));
+        strUsage += HelpMessageOpt("-chainstatewritebuffer=<n>", "Size of the chainstate database write buffer in megabytes (default: 0 = half of its cache not used as block cache)");
+        strUsage += HelpMessageOpt("-chainstateblockcache=<n>", strprintf("Percentage of the chainstate database cache used as block cache (default: %d)", DEFAULT_CHAINSTATE_BLOCK_CACHE));
+        strUsage += HelpMessageOpt("-chainstatecompression", strprintf("Compress chainstate database tables with Snappy, if LevelDB was built with it (default: %u)", 0));
+        strUsage += HelpMessageOpt("-blockindexmaxopenfiles=<n>", strprintf("Number of table files the block index database keeps open (default: %d)", DEFAULT_BLOCKINDEX_MAX_OPEN_FILES));
+        strUsage += HelpMessageOpt("-blockindexblocksize=<n>", strprintf("Size of block index database table blocks in kilobytes (default: %u)", CLevelDBOptions().nBlockSize >> 10));
+        strUsage += HelpMessageOpt("-blockindexwritebuffer=<n>", "Size of the block index database write buffer in megabytes (default: 0 = half of its cache not used as block cache)");
+        strUsage += HelpMessageOpt("-blockindexblockcache=<n>", strprintf("Percentage of the block index database cache used as block cache (default: %d)", DEFAULT_BLOCKINDEX_BLOCK_CACHE));
+        strUsage += HelpMessageOpt("-blockindexcompression", strprintf("Compress block index database tables with Snappy, if LevelDB was built with it (default: %u)", 0));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf(_("Disable safemode, override a real safe mode event (default: %u)"), 0));
         strUsage += HelpMessageOpt("-testsafemode", strprintf(_("Force safe mode (default: %u)"), 0));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", _("Randomly drop 1 of every <n> network messages"));
@@ -512,7 +536,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 41414, 41419));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
-    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d), minimum 2 required"), 4));
+    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf(_("Set the depth of the work queue to service RPC calls, requests beyond it get HTTP 503 (default: %d)"), DEFAULT_HTTP_WORKQUEUE));
+    strUsage += HelpMessageOpt("-rpcbatchconcurrency=<n>", strprintf(_("Execute up to <n> consecutive read-only calls of a batch request at once, 1 runs batches sequentially (default: %d)"), DEFAULT_RPC_BATCH_CONCURRENCY));
     strUsage += HelpMessageOpt("-rpckeepalive", strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1));
 
     strUsage += HelpMessageGroup(_("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)"));
@@ -791,11 +817,21 @@ bool AppInit2(boost::thread_group& threadGroup)
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
     nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
+    // MIN_CORE_FILEDESCRIPTORS covers DEFAULT_LEVELDB_MAX_OPEN_FILES per database, ask for the rest on top
+    CLevelDBOptions chainstateDBOptions = GetChainstateDBOptions();
+    CLevelDBOptions blockIndexDBOptions = GetBlockIndexDBOptions();
+    int nDBFiles = std::max(0, chainstateDBOptions.nMaxOpenFiles + blockIndexDBOptions.nMaxOpenFiles - 2 * DEFAULT_LEVELDB_MAX_OPEN_FILES);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + nDBFiles);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
     if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
         nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
+    // Connections come first, the chainstate table cache gets what is left
+    int nDBFilesAvailable = nFD - MIN_CORE_FILEDESCRIPTORS - nMaxConnections;
+    if (nDBFiles > nDBFilesAvailable) {
+        chainstateDBOptions.nMaxOpenFiles = std::max(DEFAULT_LEVELDB_MAX_OPEN_FILES, chainstateDBOptions.nMaxOpenFiles - (nDBFiles - nDBFilesAvailable));
+        LogPrintf("Not enough file descriptors, chainstate database limited to %d open files\n", chainstateDBOptions.nMaxOpenFiles);
+    }
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
@@ -961,8 +997,11 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1249,7 +1288,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache; // bytes, checked against the coins cache's own memory accounting
+    SetTxCacheSize(std::max((int64_t)0, GetArg("-txcachesize", DEFAULT_TX_CACHE_SIZE)));
+    blockFileMapCache.SetMaxFiles(std::max((int64_t)0, GetArg("-blockmapcache", DEFAULT_BLOCKFILE_MAP_CACHE)));
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1262,13 +1303,14 @@ bool AppInit2(boost::thread_group& threadGroup)
         do {
             try {
                 UnloadBlockIndex();
+                utxoStatsTracker.Stop();
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, blockIndexDBOptions);
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex, chainstateDBOptions);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1280,6 +1322,11 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                {
+                    LOCK(cs_main);
+                    utxoStatsTracker.Start(*pcoinsdbview, GetArg("-utxostatscheck", DEFAULT_UTXOSTATS_CHECK_INTERVAL));
+                }
+
                 // If the loaded chain has a wrong genesis, bail out immediately
                 // (we're likely using a testnet datadir, or the other way around).
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(Params().HashGenesisBlock()) == 0)
@@ -1653,6 +1700,13 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     threadGroup.create_thread(boost::bind(&ThreadCheckObfuScationPool));
 
+    // budget messages are ignored in lite mode, nothing to verify
+    if (!fLiteMode) {
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadBudgetVoteCheck);
+        threadGroup.create_thread(&ThreadBudgetVoteVerify);
+    }
+
     // ********************************************************* Step 11: start node
 
     if (!CheckDiskSpace())
@@ -8,6 +8,7 @@
 
 #include <string>
 
+class CCoinsViewDB;
 class CWallet;
 
 namespace boost
@@ -16,6 +17,8 @@ class thread_group;
 } // namespace boost
 
 extern CWallet* pwalletMain;
+/** The coins database under pcoinsTip, for its LevelDB statistics */
+extern CCoinsViewDB* pcoinsdbview;
 
 void StartShutdown();
 bool ShutdownRequested();
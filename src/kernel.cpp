@@ -6,6 +6,8 @@
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -241,27 +243,23 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool /*fPrintProofOfStake*/)
+bool GetKernelStakeModifierWalk(const CChain& chain, const CBlockIndex* pindexFrom, int64_t nSelectionInterval, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime)
 {
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
-        return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
-    int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
     const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
+    CBlockIndex* pindexNext = chain[pindexFrom->nHeight + 1];
 
     // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
+    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nSelectionInterval) {
         if (!pindexNext) {
             // Should never happen
             return error("Null pindexNext\n");
         }
 
         pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
+        pindexNext = chain[pindexNext->nHeight + 1];
         if (pindex->GeneratedStakeModifier()) {
             nStakeModifierHeight = pindex->nHeight;
             nStakeModifierTime = pindex->GetBlockTime();
@@ -271,93 +269,285 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
     return true;
 }
 
-uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom)
+void CStakeModifierTable::ConnectTip(const CBlockIndex* pindex)
 {
-    //Blocknetdx will hash in the transaction hash and the index number in order to make sure each hash is unique
-    ss << nTimeBlockFrom << prevoutIndex << prevoutHash << nTimeTx;
-    return Hash(ss.begin(), ss.end());
+    int nHeight = pindex->nHeight;
+    int nFirst = nHeight;
+    if (pindex->GeneratedStakeModifier()) {
+        for (const CBlockIndex* pindexFrom = pindex->pprev; pindexFrom && pindexFrom->nHeight >= nFirstUnresolved; pindexFrom = pindexFrom->pprev) {
+            int& nModifierHeight = vModifierHeight[pindexFrom->nHeight];
+            if (nModifierHeight < 0 && pindexFrom->GetBlockTime() + nSelectionInterval <= pindex->GetBlockTime()) {
+                nModifierHeight = nHeight;
+                nFirst = pindexFrom->nHeight;
+            }
+        }
+    }
+    vModifierHeight.push_back(-1);
+    vFirstResolved.push_back(nFirst);
+    while (nFirstUnresolved < nHeight && vModifierHeight[nFirstUnresolved] >= 0)
+        nFirstUnresolved++;
+    pindexTip = pindex;
 }
 
-//test hash vs target
-bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay)
+void CStakeModifierTable::DisconnectTip()
 {
-    //get the stake weight - weight is equal to coin amount
-    uint256 bnCoinDayWeight = uint256(nValueIn) / 100;
+    int nHeight = pindexTip->nHeight;
+    int nFirst = vFirstResolved[nHeight];
+    for (int h = nFirst; h < nHeight; h++) {
+        if (vModifierHeight[h] == nHeight)
+            vModifierHeight[h] = -1;
+    }
+    vModifierHeight.pop_back();
+    vFirstResolved.pop_back();
+    nFirstUnresolved = std::min(nFirstUnresolved, nFirst);
+    pindexTip = pindexTip->pprev;
+}
 
-    // Now check if proof-of-stake hash meets target protocol
-    return (uint256(hashProofOfStake) < bnCoinDayWeight * bnTargetPerCoinDay);
+void CStakeModifierTable::SetTip(const CBlockIndex* pindexNew)
+{
+    if (!pindexNew) {
+        // the block index may be going away, don't touch it
+        pindexTip = NULL;
+        vModifierHeight.clear();
+        vFirstResolved.clear();
+        nFirstUnresolved = 0;
+        return;
+    }
+
+    while (pindexTip && pindexNew->GetAncestor(pindexTip->nHeight) != pindexTip)
+        DisconnectTip();
+
+    std::vector<const CBlockIndex*> vConnect;
+    for (const CBlockIndex* pindex = pindexNew; pindex != pindexTip; pindex = pindex->pprev)
+        vConnect.push_back(pindex);
+    for (std::vector<const CBlockIndex*>::reverse_iterator it = vConnect.rbegin(); it != vConnect.rend(); ++it)
+        ConnectTip(*it);
 }
 
-//instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake)
+bool CStakeModifierTable::Get(const CChain& chain, const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime) const
 {
-    //assign new variables to make it easier to read
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    if (!pindexTip || chain.Tip() != pindexTip || !chain.Contains(pindexFrom))
+        return false;
+    int nModifierHeight = vModifierHeight[pindexFrom->nHeight];
+    if (nModifierHeight < 0)
+        return false;
 
-    if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
-        return error("CheckStakeKernelHash() : nTime violation");
+    const CBlockIndex* pindex = chain[nModifierHeight];
+    nStakeModifier = pindex->nStakeModifier;
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
+    return true;
+}
 
-    if (nTimeBlockFrom + Params().StakeMinAge() > nTimeTx) // Min age requirement
-        return error("CheckStakeKernelHash() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d", nTimeBlockFrom, Params().StakeMinAge(), nTimeTx);
+static CCriticalSection cs_stakeModifierTable;
+static CStakeModifierTable stakeModifierTable(GetStakeModifierSelectionInterval());
 
-    //grab difficulty
-    uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
+void UpdateStakeModifierTable(const CBlockIndex* pindexNew)
+{
+    LOCK(cs_stakeModifierTable);
+    stakeModifierTable.SetTip(pindexNew);
+}
+
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool /*fPrintProofOfStake*/)
+{
+    nStakeModifier = 0;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashBlockFrom);
+    if (it == mapBlockIndex.end())
+        return error("GetKernelStakeModifier() : block not indexed");
+    const CBlockIndex* pindexFrom = it->second;
 
-    //grab stake modifier
+    {
+        LOCK(cs_stakeModifierTable);
+        if (stakeModifierTable.Tip() != chainActive.Tip())
+            stakeModifierTable.SetTip(chainActive.Tip());
+        if (stakeModifierTable.Get(chainActive, pindexFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime))
+            return true;
+    }
+
+    // coins from blocks off the active chain, or too recent to have a modifier
+    return GetKernelStakeModifierWalk(chainActive, pindexFrom, GetStakeModifierSelectionInterval(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime);
+}
+
+bool GetStakeKernelInput(unsigned int nBits, const CBlockIndex* pindexFrom, const COutPoint& prevout, int64_t nValueIn, CStakeKernelInput& input)
+{
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake)) {
-        LogPrintf("CheckStakeKernelHash(): failed to get kernel stake modifier \n");
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+        return false;
+
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    input.prevout = prevout;
+    input.nTimeBlockFrom = pindexFrom->GetBlockTime();
+    input.nStakeModifier = nStakeModifier;
+    input.bnTarget = uint256(nValueIn) / 100 * bnTargetPerCoinDay;
+
+    // kernel hash of nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash and nTimeTx, serialized
+    unsigned char* p = input.vchPrefix;
+    WriteLE64(p, nStakeModifier);
+    WriteLE32(p + 8, input.nTimeBlockFrom);
+    WriteLE32(p + 12, prevout.n);
+    memcpy(p + 16, prevout.hash.begin(), 32);
+    return true;
+}
+
+// Kernel hash of input at nTimeTx
+static uint256 StakeKernelHash(const CStakeKernelInput& input, unsigned int nTimeTx)
+{
+    unsigned char vch[sizeof(input.vchPrefix) + 4];
+    memcpy(vch, input.vchPrefix, sizeof(input.vchPrefix));
+    WriteLE32(vch + sizeof(input.vchPrefix), nTimeTx);
+    uint256 hash;
+    CHash256().Write(vch, sizeof(vch)).Finalize((unsigned char*)&hash);
+    return hash;
+}
+
+bool SearchStakeKernel(const CStakeKernelInput& input, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTxRet, uint256& hashProofOfStake, uint64_t& nHashes)
+{
+    if (nTimeTx < input.nTimeBlockFrom) // Transaction timestamp violation
         return false;
+    if (input.nTimeBlockFrom + Params().StakeMinAge() > nTimeTx) // Min age requirement
+        return false;
+
+    for (unsigned int i = 0; i < nHashDrift; i++) {
+        unsigned int nTryTime = nTimeTx + nHashDrift - i;
+        // timestamps only get older from here on
+        if (nTryTime <= nMinTime)
+            break;
+
+        uint256 hash = StakeKernelHash(input, nTryTime);
+        nHashes++;
+        if (hash < input.bnTarget) {
+            nTimeTxRet = nTryTime;
+            hashProofOfStake = hash;
+            return true;
+        }
     }
+    return false;
+}
 
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
+bool CheckStakeKernel(unsigned int nBits, const CBlockIndex* pindexFrom, const COutPoint& prevout, int64_t nValueIn, unsigned int nTimeTx, uint256& hashProofOfStake)
+{
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
+    if (nTimeTx < nTimeBlockFrom) // Transaction timestamp violation
+        return error("CheckStakeKernel() : nTime violation");
+
+    if (nTimeBlockFrom + Params().StakeMinAge() > nTimeTx) // Min age requirement
+        return error("CheckStakeKernel() : min age violation - nTimeBlockFrom=%d nStakeMinAge=%d nTimeTx=%d", nTimeBlockFrom, Params().StakeMinAge(), nTimeTx);
 
-    //if wallet is simply checking to make sure a hash is valid
-    if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
-        return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
+    CStakeKernelInput input;
+    if (!GetStakeKernelInput(nBits, pindexFrom, prevout, nValueIn, input)) {
+        LogPrintf("CheckStakeKernel(): failed to get kernel stake modifier \n");
+        return false;
     }
 
-    bool fSuccess = false;
-    unsigned int nTryTime = 0;
-    unsigned int i;
-    for (i = 0; i < (nHashDrift); i++) //iterate the hashing
+    hashProofOfStake = StakeKernelHash(input, nTimeTx);
+    return hashProofOfStake < input.bnTarget;
+}
+
+namespace
+{
+struct CStakeKernelResult {
+    bool fFound;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+    uint64_t nHashes;
+
+    CStakeKernelResult() : fFound(false), nTimeTx(0), nHashes(0) {}
+};
+
+/**
+ * Kernel search of one coin. Reports a hit as a failed check, which makes
+ * CCheckQueue skip the checks that have not been started yet.
+ */
+class CStakeKernelCheck
+{
+private:
+    const CStakeKernelInput* pinput;
+    unsigned int nTimeTx;
+    unsigned int nHashDrift;
+    unsigned int nMinTime;
+    CStakeKernelResult* presult;
+
+public:
+    CStakeKernelCheck() : pinput(NULL), nTimeTx(0), nHashDrift(0), nMinTime(0), presult(NULL) {}
+    CStakeKernelCheck(const CStakeKernelInput* pinputIn, unsigned int nTimeTxIn, unsigned int nHashDriftIn, unsigned int nMinTimeIn, CStakeKernelResult* presultIn) : pinput(pinputIn), nTimeTx(nTimeTxIn), nHashDrift(nHashDriftIn), nMinTime(nMinTimeIn), presult(presultIn) {}
+
+    bool operator()()
     {
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        presult->fFound = SearchStakeKernel(*pinput, nTimeTx, nHashDrift, nMinTime, presult->nTimeTx, presult->hashProofOfStake, presult->nHashes);
+        return !presult->fFound;
+    }
 
-        // if stake hash does not meet the target then continue to next iteration
-        if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
-            continue;
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(pinput, check.pinput);
+        std::swap(nTimeTx, check.nTimeTx);
+        std::swap(nHashDrift, check.nHashDrift);
+        std::swap(nMinTime, check.nMinTime);
+        std::swap(presult, check.presult);
+    }
+};
+} // anon namespace
+
+static CCheckQueue<CStakeKernelCheck> stakekernelcheckqueue(8);
+/** CCheckQueue supports a single master at a time */
+static CCriticalSection cs_stakekernelcheckqueue;
+
+static CCriticalSection cs_stakekernelstats;
+static double dLastKernelsPerSecond = 0;
+static int64_t nLastKernelSearchMillis = 0;
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
-        nTimeTx = nTryTime;
-
-        if (fDebug || fPrintProofOfStake) {
-            LogPrintf("CheckStakeKernelHash() : using modifier %s at height=%d timestamp=%s for block from height=%d timestamp=%s\n",
-                boost::lexical_cast<std::string>(nStakeModifier).c_str(), nStakeModifierHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime).c_str(),
-                mapBlockIndex[blockFrom.GetHash()]->nHeight,
-                DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
-            LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
-                "0.3",
-                boost::lexical_cast<std::string>(nStakeModifier).c_str(),
-                nTimeBlockFrom, prevout.hash.ToString().c_str(), nTimeBlockFrom, prevout.n, nTryTime,
-                hashProofOfStake.ToString().c_str());
+void ThreadStakeKernelCheck()
+{
+    RenameThread("blocknetdx-stakekernel");
+    stakekernelcheckqueue.Thread();
+}
+
+int SearchStakeKernels(const std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTxRet, uint256& hashProofOfStake)
+{
+    int64_t nStart = GetTimeMicros();
+    std::vector<CStakeKernelResult> vResults(vInputs.size());
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(vInputs.size());
+    for (unsigned int i = 0; i < vInputs.size(); i++)
+        vChecks.push_back(CStakeKernelCheck(&vInputs[i], nTimeTx, nHashDrift, nMinTime, &vResults[i]));
+
+    {
+        LOCK(cs_stakekernelcheckqueue);
+        CCheckQueueControl<CStakeKernelCheck> control(&stakekernelcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    // Several workers may hit at once, prefer the coin the serial search would have used
+    int nFound = -1;
+    uint64_t nHashes = 0;
+    for (unsigned int i = 0; i < vResults.size(); i++) {
+        nHashes += vResults[i].nHashes;
+        if (nFound < 0 && vResults[i].fFound) {
+            nFound = i;
+            nTimeTxRet = vResults[i].nTimeTx;
+            hashProofOfStake = vResults[i].hashProofOfStake;
         }
-        break;
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
-    return fSuccess;
+    int64_t nElapsed = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    LogPrint("bench", "SearchStakeKernels : %u coins, %u kernels in %.2fms%s\n", vInputs.size(), nHashes, nElapsed * 0.001, nFound >= 0 ? ", found" : "");
+
+    LOCK(cs_stakekernelstats);
+    dLastKernelsPerSecond = nHashes * 1000000.0 / nElapsed;
+    nLastKernelSearchMillis = nElapsed / 1000;
+    return nFound;
+}
+
+void GetStakeKernelSearchStats(double& dKernelsPerSecond, int64_t& nSearchMillis)
+{
+    LOCK(cs_stakekernelstats);
+    dKernelsPerSecond = dLastKernelsPerSecond;
+    nSearchMillis = nLastKernelSearchMillis;
 }
 
 // Check kernel hash target and coinstake signature
@@ -370,31 +560,40 @@ bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn& txin = tx.vin[0];
 
-    // First try finding the previous transaction in database
-    uint256 hashBlock;
-    CTransaction txPrev;
-    if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-        return error("CheckProofOfStake() : INFO: read txPrev failed");
-
-    //verify signature and script
-    if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
-        return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
+    // The staked output and its block come from the coins view and the block
+    // index, so no block file has to be read
+    CTxOut txoutPrev;
+    const CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(txin.prevout.hash);
+        if (coins && coins->IsAvailable(txin.prevout.n) && coins->nHeight <= chainActive.Height()) {
+            txoutPrev = coins->vout[txin.prevout.n];
+            pindex = chainActive[coins->nHeight];
+        }
+    }
 
-    CBlockIndex* pindex = NULL;
-    BlockMap::iterator it = mapBlockIndex.find(hashBlock);
-    if (it != mapBlockIndex.end())
+    if (!pindex) {
+        // Spent on the active chain already, e.g. a block on a fork
+        uint256 hashBlock;
+        CTransaction txPrev;
+        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
+            return error("CheckProofOfStake() : INFO: read txPrev failed");
+        if (txin.prevout.n >= txPrev.vout.size())
+            return error("CheckProofOfStake() : invalid prevout on coinstake %s", tx.GetHash().ToString().c_str());
+        txoutPrev = txPrev.vout[txin.prevout.n];
+
+        BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end())
+            return error("CheckProofOfStake() : read block failed");
         pindex = it->second;
-    else
-        return error("CheckProofOfStake() : read block failed");
+    }
 
-    // Read block header
-    CBlock blockprev;
-    if (!ReadBlockFromDisk(blockprev, pindex->GetBlockPos()))
-        return error("CheckProofOfStake(): INFO: failed to find block");
+    //verify signature and script
+    if (!VerifyScript(txin.scriptSig, txoutPrev.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0)))
+        return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    unsigned int nInterval = 0;
-    unsigned int nTime = block.nTime;
-    if (!CheckStakeKernelHash(block.nBits, blockprev, txPrev, txin.prevout, nTime, nInterval, true, hashProofOfStake, fDebug))
+    if (!CheckStakeKernel(block.nBits, pindex, txin.prevout, txoutPrev.nValue, block.nTime, hashProofOfStake))
         return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s \n", tx.GetHash().ToString().c_str(), hashProofOfStake.ToString().c_str()); // may occur during initial download or if behind on block chain sync
 
     return true;
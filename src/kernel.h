@@ -20,11 +20,71 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
-// Check whether stake kernel meets hash target
-// Sets hashProofOfStake on success return
-uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
-bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
-bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
+// Walk chain forward from pindexFrom to the stake modifier that kernels of coins from pindexFrom use
+bool GetKernelStakeModifierWalk(const CChain& chain, const CBlockIndex* pindexFrom, int64_t nSelectionInterval, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime);
+
+/**
+ * For each height of a chain, the height of the block whose stake modifier is
+ * used by kernels of coins from that height: the first later block that
+ * generated a modifier at least a selection interval after it. Maintained
+ * block by block as the tip moves, so lookups don't walk the chain.
+ */
+class CStakeModifierTable
+{
+private:
+    int64_t nSelectionInterval;
+    const CBlockIndex* pindexTip;
+    std::vector<int> vModifierHeight; // -1 while no block qualifies yet
+    std::vector<int> vFirstResolved;  // lowest height connecting this block resolved, to undo it on disconnect
+    int nFirstUnresolved;
+
+    void ConnectTip(const CBlockIndex* pindex);
+    void DisconnectTip();
+
+public:
+    CStakeModifierTable(int64_t nSelectionIntervalIn) : nSelectionInterval(nSelectionIntervalIn), pindexTip(NULL), nFirstUnresolved(0) {}
+
+    const CBlockIndex* Tip() const { return pindexTip; }
+    void SetTip(const CBlockIndex* pindexNew);
+
+    // Same result as GetKernelStakeModifierWalk, returns false if chain does not end at Tip() or no modifier applies yet
+    bool Get(const CChain& chain, const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime) const;
+};
+
+// Move the stake modifier table of chainActive to pindexNew, requires cs_main
+void UpdateStakeModifierTable(const CBlockIndex* pindexNew);
+
+/**
+ * Inputs of the stake kernel hash that stay the same for a coin as long as the
+ * chain tip does not change, so a staking round only has to hash the timestamps.
+ */
+struct CStakeKernelInput {
+    COutPoint prevout;
+    unsigned int nTimeBlockFrom;
+    uint64_t nStakeModifier;
+    uint256 bnTarget; // target per coin day times the coin value / 100
+    unsigned char vchPrefix[8 + 4 + 4 + 32]; // serialized kernel hash fields before nTimeTx
+};
+
+// Look up the stake modifier of the coin at prevout from block pindexFrom and precompute its kernel inputs, requires cs_main
+bool GetStakeKernelInput(unsigned int nBits, const CBlockIndex* pindexFrom, const COutPoint& prevout, int64_t nValueIn, CStakeKernelInput& input);
+
+// Try nTimeTx + nHashDrift down to nTimeTx + 1, newest first, skipping timestamps not after nMinTime.
+// nHashes is increased by the number of kernel hashes computed.
+bool SearchStakeKernel(const CStakeKernelInput& input, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTxRet, uint256& hashProofOfStake, uint64_t& nHashes);
+
+// Check whether the kernel of the coin at prevout from block pindexFrom meets the hash target at nTimeTx
+// Sets hashProofOfStake
+bool CheckStakeKernel(unsigned int nBits, const CBlockIndex* pindexFrom, const COutPoint& prevout, int64_t nValueIn, unsigned int nTimeTx, uint256& hashProofOfStake);
+
+// Search vInputs for a kernel across the stake kernel check threads, stopping at the first hit.
+// Returns the index of the input that hit, or -1.
+int SearchStakeKernels(const std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeTx, unsigned int nHashDrift, unsigned int nMinTime, unsigned int& nTimeTxRet, uint256& hashProofOfStake);
+
+// Kernel hashes per second and duration in milliseconds of the last SearchStakeKernels call
+void GetStakeKernelSearchStats(double& dKernelsPerSecond, int64_t& nSearchMillis);
+
+void ThreadStakeKernelCheck();
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
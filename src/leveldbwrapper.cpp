@@ -5,6 +5,7 @@
 #include "leveldbwrapper.h"
 
 #include "util.h"
+#include "utilstrencodings.h"
 
 #include <boost/filesystem.hpp>
 
@@ -27,14 +28,20 @@ void HandleError(const leveldb::Status& status) throw(leveldb_error)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const CLevelDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    size_t nBlockCacheSize = (uint64_t)nCacheSize * dbOptions.nBlockCacheShare / 100;
+    options.block_cache = leveldb::NewLRUCache(nBlockCacheSize);
+    if (dbOptions.nWriteBufferSize)
+        options.write_buffer_size = dbOptions.nWriteBufferSize;
+    else
+        options.write_buffer_size = (nCacheSize - nBlockCacheSize) / 2; // up to two write buffers may be held in memory simultaneously
+    options.block_size = dbOptions.nBlockSize;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // Without Snappy compiled in LevelDB quietly stores blocks uncompressed
+    options.compression = dbOptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +50,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSizeIn, bool fMemory, bool fWipe, const CLevelDBOptions& dbOptionsIn)
+    : dbOptions(dbOptionsIn), nCacheSize(nCacheSizeIn)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -66,6 +74,8 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrintf("LevelDB options: max_open_files=%d block_size=%u write_buffer_size=%u block_cache=%u compression=%d\n",
+        options.max_open_files, options.block_size, options.write_buffer_size, (uint64_t)nCacheSize * dbOptions.nBlockCacheShare / 100, dbOptions.fCompression);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
@@ -80,6 +90,56 @@ CLevelDBWrapper::~CLevelDBWrapper()
     options.env = NULL;
 }
 
+CLevelDBSnapshot::CLevelDBSnapshot(const CLevelDBWrapper& dbIn) : db(dbIn)
+{
+    psnapshot = db.pdb->GetSnapshot();
+    readoptions = db.readoptions;
+    readoptions.snapshot = psnapshot;
+    iteroptions = db.iteroptions;
+    iteroptions.snapshot = psnapshot;
+}
+
+CLevelDBSnapshot::~CLevelDBSnapshot()
+{
+    db.pdb->ReleaseSnapshot(psnapshot);
+}
+
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CLevelDBWrapper::GetApproximateSize(unsigned char chPrefix) const
+{
+    // Keys are serialized starting with their one character prefix
+    std::string strBegin(1, (char)chPrefix);
+    std::string strEnd = chPrefix == 0xff ? std::string(64, (char)0xff) : std::string(1, (char)(chPrefix + 1));
+    leveldb::Range range(strBegin, strEnd);
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CLevelDBWrapper::GetStats(CLevelDBStats& stats) const
+{
+    GetProperty("leveldb.stats", stats.strStats);
+    stats.vFilesAtLevel.clear();
+    for (int nLevel = 0;; nLevel++) {
+        std::string strFiles;
+        if (!GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strFiles))
+            break;
+        stats.vFilesAtLevel.push_back(atoi(strFiles));
+    }
+    std::string strMemory;
+    if (GetProperty("leveldb.approximate-memory-usage", strMemory))
+        stats.nMemoryUsage = atoi64(strMemory);
+
+    std::string strBegin(1, (char)0x00);
+    std::string strEnd(64, (char)0xff);
+    leveldb::Range range(strBegin, strEnd);
+    pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+}
+
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync) throw(leveldb_error)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -11,6 +11,10 @@
 #include "util.h"
 #include "version.h"
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -24,6 +28,30 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(leveldb_error);
 
+//! Default number of table files LevelDB keeps open per database
+static const int DEFAULT_LEVELDB_MAX_OPEN_FILES = 64;
+
+/** Tuning of one LevelDB database, next to its memory budget */
+struct CLevelDBOptions {
+    int nMaxOpenFiles;
+    size_t nBlockSize;       //!< uncompressed bytes per table block
+    size_t nWriteBufferSize; //!< 0 to use half of what the block cache leaves of the budget
+    int nBlockCacheShare;    //!< percentage of the memory budget used as block cache
+    bool fCompression;       //!< Snappy compression of table blocks; stored uncompressed if LevelDB lacks Snappy
+
+    CLevelDBOptions() : nMaxOpenFiles(DEFAULT_LEVELDB_MAX_OPEN_FILES), nBlockSize(4096), nWriteBufferSize(0), nBlockCacheShare(50), fCompression(false) {}
+};
+
+/** Runtime figures reported by LevelDB, see CLevelDBWrapper::GetStats */
+struct CLevelDBStats {
+    std::string strStats;           //!< "leveldb.stats": per level files, size and compaction work
+    std::vector<int> vFilesAtLevel; //!< "leveldb.num-files-at-level<N>"
+    uint64_t nMemoryUsage;          //!< "leveldb.approximate-memory-usage"
+    uint64_t nApproximateSize;      //!< file system space used by all keys
+
+    CLevelDBStats() : nMemoryUsage(0), nApproximateSize(0) {}
+};
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -63,6 +91,8 @@ public:
 
 class CLevelDBWrapper
 {
+    friend class CLevelDBSnapshot;
+
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -85,12 +115,22 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! tuning the database was opened with
+    CLevelDBOptions dbOptions;
+    size_t nCacheSize;
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSizeIn, bool fMemory = false, bool fWipe = false, const CLevelDBOptions& dbOptionsIn = CLevelDBOptions());
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const throw(leveldb_error)
+    {
+        return Read(readoptions, key, value);
+    }
+
+    template <typename K, typename V>
+    bool Read(const leveldb::ReadOptions& options, const K& key, V& value) const throw(leveldb_error)
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
@@ -98,7 +138,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -163,6 +203,17 @@ public:
         return WriteBatch(batch, true);
     }
 
+    const CLevelDBOptions& GetDBOptions() const { return dbOptions; }
+    size_t GetCacheSize() const { return nCacheSize; }
+
+    //! Value of a LevelDB property such as "leveldb.stats"; false if the property is unknown
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    //! Approximate file system space used by the keys whose serialization starts with chPrefix
+    uint64_t GetApproximateSize(unsigned char chPrefix) const;
+
+    void GetStats(CLevelDBStats& stats) const;
+
     // not exactly clean encapsulation, but it's easiest for now
     leveldb::Iterator* NewIterator()
     {
@@ -170,4 +221,37 @@ public:
     }
 };
 
+/**
+ * Read-only view of a CLevelDBWrapper frozen at construction: writes made
+ * afterwards are not visible through it, so long reads need no lock against
+ * writers. Keep it short lived, it pins the files of the state it sees.
+ */
+class CLevelDBSnapshot
+{
+private:
+    // Disallow copies, the snapshot is released on destruction
+    CLevelDBSnapshot(const CLevelDBSnapshot&);
+    CLevelDBSnapshot& operator=(const CLevelDBSnapshot&);
+
+    const CLevelDBWrapper& db;
+    const leveldb::Snapshot* psnapshot;
+    leveldb::ReadOptions readoptions;
+    leveldb::ReadOptions iteroptions;
+
+public:
+    explicit CLevelDBSnapshot(const CLevelDBWrapper& dbIn);
+    ~CLevelDBSnapshot();
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const throw(leveldb_error)
+    {
+        return db.Read(readoptions, key, value);
+    }
+
+    leveldb::Iterator* NewIterator() const
+    {
+        return db.pdb->NewIterator(iteroptions);
+    }
+};
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
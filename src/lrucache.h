@@ -0,0 +1,89 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+/** STL-like map container that only keeps the N most recently used elements. */
+template <typename K, typename V>
+class lrucache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef typename std::list<value_type>::size_type size_type;
+
+protected:
+    typedef typename std::list<value_type>::iterator list_iterator;
+    std::list<value_type> items; // most recently used first
+    std::map<K, list_iterator> index;
+    size_type nMaxSize;
+
+public:
+    lrucache(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    size_type size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    size_type count(const key_type& k) const { return index.count(k); }
+    void clear()
+    {
+        items.clear();
+        index.clear();
+    }
+
+    /** Look up k, copy its value into v and mark it as most recently used. */
+    bool get(const key_type& k, mapped_type& v)
+    {
+        typename std::map<K, list_iterator>::iterator it = index.find(k);
+        if (it == index.end())
+            return false;
+        items.splice(items.begin(), items, it->second);
+        v = it->second->second;
+        return true;
+    }
+
+    /** Insert or replace the value for k, evicting the least recently used element if full. */
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        typename std::map<K, list_iterator>::iterator it = index.find(k);
+        if (it != index.end()) {
+            it->second->second = v;
+            items.splice(items.begin(), items, it->second);
+            return;
+        }
+        if (nMaxSize && items.size() >= nMaxSize) {
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+        items.push_front(value_type(k, v));
+        index.insert(std::make_pair(k, items.begin()));
+    }
+
+    void erase(const key_type& k)
+    {
+        typename std::map<K, list_iterator>::iterator it = index.find(k);
+        if (it == index.end())
+            return;
+        items.erase(it->second);
+        index.erase(it);
+    }
+
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        if (s)
+            while (items.size() > s) {
+                index.erase(items.back().first);
+                items.pop_back();
+            }
+        nMaxSize = s;
+        return nMaxSize;
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
@@ -11,11 +11,13 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "init.h"
 #include "kernel.h"
+#include "lrucache.h"
 #include "servicenode-budget.h"
 #include "servicenode-payments.h"
 #include "servicenodeman.h"
@@ -30,6 +32,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 #include "xbridge/xbridgeapp.h"
 #include "coinvalidator.h"
 
@@ -69,7 +72,7 @@ bool fReindex = false;
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 CoinValidator &coinValidator = CoinValidator::instance();
 
@@ -1113,6 +1116,57 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
+/** Drop expired transactions, then evict the lowest fee rate packages until the pool fits nLimit bytes */
+static void LimitMempoolSize(CTxMemPool& pool, uint64_t nLimit, int64_t nAge, std::list<CTransaction>& removed)
+{
+    int nExpired = pool.Expire(GetTime() - nAge, removed);
+    if (nExpired)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", nExpired);
+
+    size_t nBefore = removed.size();
+    pool.TrimToSize(nLimit, removed);
+    if (removed.size() > nBefore)
+        LogPrint("mempool", "Evicted %u transactions to keep the memory pool below %u bytes\n", removed.size() - nBefore, nLimit);
+}
+
+/** Script checks of loose transactions, kept apart from scriptcheckqueue which ConnectBlock owns */
+static CCheckQueue<CScriptCheck> mempoolcheckqueue(128);
+/** CCheckQueue supports a single master at a time */
+static CCriticalSection cs_mempoolcheckqueue;
+
+void ThreadMempoolScriptCheck()
+{
+    RenameThread("blocknetdx-mpscriptch");
+    mempoolcheckqueue.Thread();
+}
+
+/** Run vChecks across the mempool script check workers, returns whether all of them passed */
+static bool RunMempoolScriptChecks(std::vector<CScriptCheck>& vChecks)
+{
+    LOCK(cs_mempoolcheckqueue);
+    CCheckQueueControl<CScriptCheck> control(&mempoolcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+/**
+ * CheckInputs for mempool acceptance. Transactions with many inputs have their
+ * signatures verified in parallel; on failure the checks are repeated inline so
+ * the rejection reason and DoS score are exactly those of the serial path.
+ */
+static bool CheckInputsMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags)
+{
+    if (!fScriptChecks || !nScriptCheckThreads || tx.vin.size() < MEMPOOL_PARALLEL_SCRIPT_MIN_INPUTS)
+        return CheckInputs(tx, state, view, fScriptChecks, flags, true);
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, &vChecks))
+        return false;
+    if (RunMempoolScriptChecks(vChecks))
+        return true;
+    return CheckInputs(tx, state, view, true, flags, true);
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
@@ -1289,7 +1343,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!CheckInputsMempool(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1308,6 +1362,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry);
+
+        std::list<CTransaction> removed;
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60, removed);
+        // Tell wallets about transactions that went from mempool to expired or evicted
+        BOOST_FOREACH (const CTransaction& txRemoved, removed) {
+            SyncWithWallets(txRemoved, NULL);
+        }
+        if (!pool.exists(hash))
+            return state.DoS(0, error("AcceptToMemoryPool : mempool full, %s evicted", hash.ToString()),
+                REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     SyncWithWallets(tx, NULL);
@@ -1478,7 +1542,8 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        // Inputs only: callers pass obfuscation entries and servicenode vins before they are signed.
+        if (!CheckInputsMempool(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS)) {
             return error("AcceptableInputs: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1506,43 +1571,133 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+/**
+ * Locate the serialized block at pos inside its memory mapped block file.
+ * On success pbegin points at nSize bytes of block data that stay valid while mapped is held.
+ */
+static bool GetMappedBlock(const CDiskBlockPos& pos, CMappedBlockFileRef& mapped, const char*& pbegin, unsigned int& nSize)
+{
+    // Every block is preceded by the message start and its length
+    if (pos.IsNull() || pos.nPos < 8)
+        return false;
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    mapped = blockFileMapCache.Get(pos.nFile, path, pos.nPos);
+    if (!mapped)
+        return false;
+
+    unsigned char pchMessageStart[MESSAGE_START_SIZE];
+    try {
+        CMemoryReader header(mapped->data() + pos.nPos - 8, mapped->data() + pos.nPos, SER_DISK, CLIENT_VERSION);
+        header >> FLATDATA(pchMessageStart) >> nSize;
+    } catch (std::exception& e) {
+        return false;
+    }
+    if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) || nSize > MAX_BLOCK_SIZE)
+        return false;
+
+    if (mapped->size() < (size_t)pos.nPos + nSize) {
+        mapped = blockFileMapCache.Get(pos.nFile, path, (size_t)pos.nPos + nSize);
+        if (!mapped)
+            return false;
+    }
+    pbegin = mapped->data() + pos.nPos;
+    return true;
+}
+
+/** Recently read confirmed transactions, keyed by txid (protected by cs_txCache) */
+static CCriticalSection cs_txCache;
+static lrucache<uint256, std::pair<CTransaction, uint256> > txCache(DEFAULT_TX_CACHE_SIZE);
+static bool fTxCacheEnabled = DEFAULT_TX_CACHE_SIZE > 0;
+
+void SetTxCacheSize(unsigned int nSize)
+{
+    LOCK(cs_txCache);
+    fTxCacheEnabled = nSize > 0;
+    if (fTxCacheEnabled)
+        txCache.max_size(nSize);
+    else
+        txCache.clear();
+}
+
+static void EraseTxCacheForBlock(const CBlock& block)
+{
+    LOCK(cs_txCache);
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        txCache.erase(tx.GetHash());
+}
+
+/** Read a transaction at a known txindex position. Must not be called with cs_main held. */
+static bool ReadTransactionFromDisk(const CDiskTxPos& postx, const uint256& hash, CTransaction& txOut, uint256& hashBlock)
+{
+    CMappedBlockFileRef mapped;
+    const char* pbegin = NULL;
+    unsigned int nSize = 0;
+    if (GetMappedBlock(postx, mapped, pbegin, nSize)) {
+        CBlockHeader header;
+        try {
+            CMemoryReader reader(pbegin, pbegin + nSize, SER_DISK, CLIENT_VERSION);
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> txOut;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+        hashBlock = header.GetHash();
+        if (txOut.GetHash() != hash)
+            return error("%s : txid mismatch", __func__);
+        return true;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    if (txOut.GetHash() != hash)
+        return error("%s : txid mismatch", __func__);
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
-    CBlockIndex* pindexSlow = NULL;
+    // mempool has its own lock
+    if (mempool.lookup(hash, txOut))
+        return true;
+
+    // The cache only holds what the txindex or slow lookups below could find
+    if (!fTxIndex && !fAllowSlow)
+        return false;
+
     {
-        LOCK(cs_main);
-        {
-            if (mempool.lookup(hash, txOut)) {
-                return true;
-            }
+        LOCK(cs_txCache);
+        std::pair<CTransaction, uint256> cached;
+        if (fTxCacheEnabled && txCache.get(hash, cached)) {
+            txOut = cached.first;
+            hashBlock = cached.second;
+            return true;
         }
+    }
 
+    // Only the index lookups need cs_main; block files are read without it
+    CBlockIndex* pindexSlow = NULL;
+    CDiskTxPos postx;
+    bool fHavePos = false;
+    {
+        LOCK(cs_main);
         if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
-
+            fHavePos = pblocktree->ReadTxIndex(hash, postx);
             // transaction not found in the index, nothing more can be done
-            return false;
-        }
-
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+            if (!fHavePos)
+                return false;
+        } else if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
                 CCoinsViewCache& view = *pcoinsTip;
@@ -1555,20 +1710,34 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         }
     }
 
-    if (pindexSlow) {
+    bool fFound = false;
+    if (fHavePos) {
+        if (!ReadTransactionFromDisk(postx, hash, txOut, hashBlock))
+            return false;
+        fFound = true;
+    } else if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
             BOOST_FOREACH (const CTransaction& tx, block.vtx) {
                 if (tx.GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
-                    return true;
+                    fFound = true;
+                    break;
                 }
             }
         }
     }
 
-    return false;
+    if (fFound) {
+        // The block may have been disconnected while it was read, and
+        // EraseTxCacheForBlock would already have run for it
+        LOCK2(cs_main, cs_txCache);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (fTxCacheEnabled && mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+            txCache.insert(hash, std::make_pair(txOut, hashBlock));
+    }
+    return fFound;
 }
 
 
@@ -1598,10 +1767,8 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+static bool ReadBlockFromDiskFile(CBlock& block, const CDiskBlockPos& pos)
 {
-    block.SetNull();
-
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -1614,6 +1781,30 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    block.SetNull();
+
+    CMappedBlockFileRef mapped;
+    const char* pbegin = NULL;
+    unsigned int nSize = 0;
+    if (GetMappedBlock(pos, mapped, pbegin, nSize)) {
+        // Deserialize straight from the mapped file
+        try {
+            CMemoryReader reader(pbegin, pbegin + nSize, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Fall back to stdio
+        if (!ReadBlockFromDiskFile(block, pos))
+            return false;
+    }
+
     // Check the header
     if (block.IsProofOfWork()) {
         if (!CheckProofOfWork(block.GetHash(), block.nBits))
@@ -1623,6 +1814,39 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CDiskBlockPos& pos)
+{
+    CMappedBlockFileRef mapped;
+    const char* pbegin = NULL;
+    unsigned int nSize = 0;
+    if (GetMappedBlock(pos, mapped, pbegin, nSize)) {
+        vchBlock.assign(pbegin, pbegin + nSize);
+        return true;
+    }
+
+    // Open history file at the message start preceding the block
+    if (pos.IsNull() || pos.nPos < 8)
+        return error("%s : invalid block position", __func__);
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 8), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE))
+            return error("%s : block magic mismatch", __func__);
+        if (nSize > MAX_BLOCK_SIZE)
+            return error("%s : block size %u too large", __func__, nSize);
+        vchBlock.resize(nSize);
+        if (nSize)
+            filein.read(&vchBlock[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2065,6 +2289,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    // Never keep a mapping across a truncation of the file
+    if (fFinalize)
+        blockFileMapCache.Invalidate(nLastBlockFile);
+
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
         if (fFinalize)
@@ -2353,7 +2581,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     try {
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -2386,6 +2614,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (pcoinsdbview)
+                utxoStatsTracker.Flushed(*pcoinsdbview);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 g_signals.SetBestChain(chainActive.GetLocator());
@@ -2408,15 +2638,16 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    UpdateStakeModifierTable(pindexNew);
 
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-              SyncProgress(chainActive.Height()), (unsigned int)pcoinsTip->GetCacheSize());
+              SyncProgress(chainActive.Height()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -2457,8 +2688,12 @@ bool static DisconnectTip(CValidationState& state)
         CCoinsViewCache view(pcoinsTip);
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        utxoStatsTracker.BlockDisconnected(block, pindexDelete->pprev, *pcoinsTip, view);
         assert(view.Flush());
     }
+    // Cached lookups must not keep pointing at a block that left the active chain
+    EraseTxCacheForBlock(block);
+    servicenodeCollateralCache.BlockDisconnected(block);
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
@@ -2483,6 +2718,97 @@ bool static DisconnectTip(CValidationState& state)
     return true;
 }
 
+/** Reads the coins of one transaction from the coins database for PrefetchBlockInputs */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsViewCache* view;
+    uint256 txid;
+    CCoins* pcoins;
+    char* pfFound;
+
+public:
+    CCoinsPrefetchCheck() : view(NULL), pcoins(NULL), pfFound(NULL) {}
+    CCoinsPrefetchCheck(const CCoinsViewCache* viewIn, const uint256& txidIn, CCoins* pcoinsIn, char* pfFoundIn)
+        : view(viewIn), txid(txidIn), pcoins(pcoinsIn), pfFound(pfFoundIn) {}
+
+    bool operator()()
+    {
+        *pfFound = view->GetCoinsFromBase(txid, *pcoins);
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check)
+    {
+        std::swap(view, check.view);
+        std::swap(txid, check.txid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(16);
+
+void ThreadCoinsPrefetch()
+{
+    RenameThread("blocknetdx-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+/**
+ * Warm pcoinsTip with the coins spent by block, so ConnectBlock's serial pass
+ * finds them in memory. Cache misses are read from the database concurrently
+ * and inserted afterwards; outputs created inside the block itself are skipped.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setBlockTx;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        setBlockTx.insert(tx.GetHash());
+
+    std::set<uint256> setSeen;
+    std::vector<uint256> vTxid;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            const uint256& hash = txin.prevout.hash;
+            if (setBlockTx.count(hash) || !setSeen.insert(hash).second)
+                continue;
+            if (!pcoinsTip->HaveCoinsInCache(hash))
+                vTxid.push_back(hash);
+        }
+    }
+    if (vTxid.size() < COINS_PREFETCH_MIN_TXIDS)
+        return;
+
+    std::vector<CCoins> vCoins(vTxid.size());
+    std::vector<char> vFound(vTxid.size(), 0);
+    std::vector<CCoinsPrefetchCheck> vChecks;
+    vChecks.reserve(vTxid.size());
+    for (unsigned int i = 0; i < vTxid.size(); i++)
+        vChecks.push_back(CCoinsPrefetchCheck(pcoinsTip, vTxid[i], &vCoins[i], &vFound[i]));
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        if (vFound[i]) {
+            pcoinsTip->AddFetchedCoins(vTxid[i], vCoins[i]);
+            nFound++;
+        }
+    }
+    LogPrint("bench", "  - Prefetch %u/%u input transactions: %.2fms\n", nFound, (unsigned int)vTxid.size(), (GetTimeMicros() - nTimeStart) * 0.001);
+}
+
 static int64_t nTimeReadFromDisk = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
@@ -2512,6 +2838,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockInputs(*pblock);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false);
@@ -2522,6 +2849,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
             return error("ConnectTip() : ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         mapBlockSource.erase(inv.hash);
+        servicenodeCollateralCache.BlockConnected(*pblock);
+        utxoStatsTracker.BlockConnected(*pblock, pindexNew, *pcoinsTip, view);
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
@@ -2837,6 +3166,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock)
                         pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
             }
             // Notify external listeners about the new tip.
+            GetMainSignals().UpdatedBlockTip(pindexNewTip, pblock && pblock->GetHash() == hashNewTip ? pblock : NULL);
             uiInterface.NotifyBlockTip(hashNewTip);
         }
     } while (pindexMostWork != chainActive.Tip());
@@ -3943,7 +4273,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -3985,6 +4315,8 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateStakeModifierTable(NULL);
+    servicenodeCollateralCache.Clear();
     pindexBestInvalid = NULL;
 }
 
@@ -4525,6 +4857,40 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+/**
+ * Push the block as a "block" message straight from its serialized bytes on disk.
+ * Only the header is decoded, to make sure the bytes belong to pindex.
+ */
+static bool PushRawBlock(CNode* pfrom, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    CMappedBlockFileRef mapped;
+    const char* pbegin = NULL;
+    unsigned int nSize = 0;
+    std::vector<char> vchBlock;
+    if (GetMappedBlock(pos, mapped, pbegin, nSize)) {
+        // send from the mapped file, the mapping is held until the message is framed
+    } else if (ReadRawBlockFromDisk(vchBlock, pos) && !vchBlock.empty()) {
+        pbegin = &vchBlock[0];
+        nSize = vchBlock.size();
+    } else {
+        return false;
+    }
+
+    CBlockHeader header;
+    try {
+        CMemoryReader reader(pbegin, pbegin + nSize, SER_DISK, CLIENT_VERSION);
+        reader >> header;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize error - %s", __func__, e.what());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s : GetHash() doesn't match index for %s", __func__, pindex->GetBlockHash().ToString());
+
+    pfrom->PushMessage("block", CFlatData((void*)pbegin, (void*)(pbegin + nSize)));
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4563,15 +4929,22 @@ void static ProcessGetData(CNode* pfrom)
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        // Frame the serialized bytes directly, without a decode/encode round trip
+                        if (!PushRawBlock(pfrom, (*mi).second)) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            pfrom->PushMessage("block", block);
+                        }
+                    } else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
+                        // Without a filter nothing is sent, so don't bother loading the block
                         if (pfrom->pfilter) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
                             pfrom->PushMessage("merkleblock", merkleBlock);
                             // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
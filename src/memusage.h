@@ -0,0 +1,35 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMUSAGE_H
+#define BITCOIN_MEMUSAGE_H
+
+#include <stddef.h>
+#include <vector>
+
+/** Helpers to compute the heap memory used by containers, including the allocator's own overhead */
+namespace memusage
+{
+/** Heap bytes consumed by a malloc of alloc bytes, as done by glibc's allocator */
+static inline size_t MallocUsage(size_t alloc)
+{
+    if (alloc == 0)
+        return 0;
+    if (sizeof(void*) == 8)
+        return ((alloc + 31) >> 4) << 4;
+    if (sizeof(void*) == 4)
+        return ((alloc + 15) >> 3) << 3;
+    return alloc;
+}
+
+/** Heap bytes owned by a vector, not counting what its elements point to */
+template <typename X>
+static inline size_t DynamicUsage(const std::vector<X>& v)
+{
+    return MallocUsage(v.capacity() * sizeof(X));
+}
+
+} // namespace memusage
+
+#endif // BITCOIN_MEMUSAGE_H
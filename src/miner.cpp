@@ -25,7 +25,6 @@
 #include "servicenode-payments.h"
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 
 using namespace std;
 
@@ -36,52 +35,152 @@ using namespace std;
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool. The pool keeps the fee and size of each
+// transaction's in-pool ancestors, so transactions are selected as packages:
+// a transaction goes into the block together with whichever of its
+// ancestors are not in the block yet, best ancestor fee rate first.
 //
-class COrphan
+// CTxSelection tracks the block being filled while CreateNewBlock is
+// figuring out which transactions to include. Once a transaction is in,
+// its in-pool descendants have a smaller package than the pool says;
+// those are kept apart as modified entries and ranked by what is left.
+//
+class CTxSelection
 {
 public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+    /** Ancestor package of a pool entry less the ancestors already in the block */
+    struct CModifiedEntry {
+        uint64_t nSizeWithAncestors;
+        CAmount nModFeesWithAncestors;
+    };
+
+    CBlockTemplate* pblocktemplate;
+    CCoinsViewCache& view;
+    int nHeight;
+    bool fPrintPriority;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    CAmount nFees;
+    std::set<uint256> setInBlock;
+    std::map<uint256, CModifiedEntry> mapModified;
+    CMemPoolScoreIndex setModified;
+
+    CTxSelection(CBlockTemplate* pblocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn) : pblocktemplate(pblocktemplateIn), view(viewIn), nHeight(nHeightIn),
+                                                                                                 nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0)
     {
+        fPrintPriority = GetBoolArg("-printpriority", false);
     }
-};
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockSize = 0;
-int64_t nLastCoinStakeSearchInterval = 0;
+    /** Add entry on top of the block if it fits and is valid there. All its in-pool parents must already be in. */
+    bool TryAdd(const CTxMemPoolEntry& entry, unsigned int nBlockMaxSize, double dPriority, const CFeeRate& feeRate)
+    {
+        const CTransaction& tx = entry.GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+            return false;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
-{
-    bool byFee;
+        // Size limits
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBlockSize + nTxSize >= nBlockMaxSize)
+            return false;
 
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            return false;
 
-    bool operator()(const TxPriority& a, const TxPriority& b)
+        if (!view.HaveInputs(tx))
+            return false;
+
+        CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+        nTxSigOps += GetP2SHSigOpCount(tx, view);
+        if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            return false;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+        CValidationState state;
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+            return false;
+
+        CTxUndo txundo;
+        UpdateCoins(tx, state, view, txundo, nHeight);
+
+        // Added
+        pblocktemplate->block.vtx.push_back(tx);
+        pblocktemplate->vTxFees.push_back(nTxFees);
+        pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+        nBlockSize += nTxSize;
+        ++nBlockTx;
+        nBlockSigOps += nTxSigOps;
+        nFees += nTxFees;
+        setInBlock.insert(tx.GetHash());
+        UpdatePackagesForAdded(entry);
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, feeRate.ToString(), tx.GetHash().ToString());
+        }
+        return true;
+    }
+
+    /** Take entry, just added to the block, off the packages of its descendants */
+    void UpdatePackagesForAdded(const CTxMemPoolEntry& entry)
     {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
+        const uint256& hash = entry.GetTx().GetHash();
+        std::map<uint256, CModifiedEntry>::iterator itSelf = mapModified.find(hash);
+        if (itSelf != mapModified.end()) {
+            setModified.erase(CMemPoolScore(itSelf->second.nModFeesWithAncestors, itSelf->second.nSizeWithAncestors, hash));
+            mapModified.erase(itSelf);
         }
+
+        std::set<uint256> setDescendants;
+        mempool.CalculateDescendants(hash, setDescendants);
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+            if (setInBlock.count(hashDescendant))
+                continue;
+            std::map<uint256, CModifiedEntry>::iterator it = mapModified.find(hashDescendant);
+            if (it == mapModified.end()) {
+                const CTxMemPoolEntry& descendant = mempool.mapTx[hashDescendant];
+                CModifiedEntry modified;
+                modified.nSizeWithAncestors = descendant.GetSizeWithAncestors();
+                modified.nModFeesWithAncestors = descendant.GetModFeesWithAncestors();
+                it = mapModified.insert(std::make_pair(hashDescendant, modified)).first;
+            } else {
+                setModified.erase(CMemPoolScore(it->second.nModFeesWithAncestors, it->second.nSizeWithAncestors, hashDescendant));
+            }
+            it->second.nSizeWithAncestors -= entry.GetTxSize();
+            it->second.nModFeesWithAncestors -= entry.GetModifiedFee();
+            setModified.insert(CMemPoolScore(it->second.nModFeesWithAncestors, it->second.nSizeWithAncestors, hashDescendant));
+        }
+    }
+
+    /** Drop a modified entry that is about to be tried, so it is not offered again */
+    void RemoveModified(const uint256& hash)
+    {
+        std::map<uint256, CModifiedEntry>::iterator it = mapModified.find(hash);
+        if (it == mapModified.end())
+            return;
+        setModified.erase(CMemPoolScore(it->second.nModFeesWithAncestors, it->second.nSizeWithAncestors, hash));
+        mapModified.erase(it);
+    }
+};
+
+/** Orders a package so that every transaction comes after its in-pool ancestors */
+struct CompareByAncestorCount {
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
     }
 };
 
+uint64_t nLastBlockTx = 0;
+uint64_t nLastBlockSize = 0;
+int64_t nLastCoinStakeSearchInterval = 0;
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -167,171 +266,103 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+        CTxSelection selection(pblocktemplate.get(), view, nHeight);
+
+        // Priority area: old, high value coins get in regardless of their fees.
+        // The pool keeps an index by priority at the height of the next block,
+        // so this only visits the transactions that make it into the area.
+        // Only transactions with confirmed inputs take part, dependent ones are
+        // handled with their package below.
+        if (nBlockPrioritySize > 0) {
+            std::set<std::pair<double, uint256> >::const_reverse_iterator it = mempool.setByPriority.rbegin();
+            for (; it != mempool.setByPriority.rend(); ++it) {
+                if (!AllowFree(it->first))
+                    break;
+                const CTxMemPoolEntry& entry = mempool.mapTx[it->second];
+                if (entry.GetCountWithAncestors() != 1)
                     continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
+                if (selection.nBlockSize + entry.GetTxSize() >= nBlockPrioritySize)
+                    break;
+                selection.TryAdd(entry, nBlockMaxSize, it->first, CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()));
             }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
         }
 
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
+        // Fee area: take the best package of either the mempool's ancestor score
+        // index or the modified entries, whose ancestors are partly in the block
+        set<uint256> setFailed;
+        CMemPoolScoreIndex::const_reverse_iterator mi = mempool.setByAncestorScore.rbegin();
+        while (mi != mempool.setByAncestorScore.rend() || !selection.setModified.empty()) {
+            // Nothing useful fits anymore
+            if (selection.nBlockSize + 100 >= nBlockMaxSize)
+                break;
 
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            // Skip pool entries that are already handled, or ranked by their modified package
+            if (mi != mempool.setByAncestorScore.rend() &&
+                (selection.setInBlock.count(mi->hash) || setFailed.count(mi->hash) || selection.mapModified.count(mi->hash))) {
+                ++mi;
                 continue;
+            }
 
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+            CMemPoolScore score = mi != mempool.setByAncestorScore.rend() ? *mi : *selection.setModified.rbegin();
+            if (!selection.setModified.empty() && score < *selection.setModified.rbegin()) {
+                score = *selection.setModified.rbegin();
             }
+            if (selection.mapModified.count(score.hash))
+                selection.RemoveModified(score.hash);
+            else
+                ++mi;
 
-            if (!view.HaveInputs(tx))
+            const uint256& hash = score.hash;
+            if (setFailed.count(hash))
                 continue;
+            const CTxMemPoolEntry& entry = mempool.mapTx[hash];
+            uint64_t nPackageSize = score.nSize;
+            CFeeRate packageRate(score.nFee, nPackageSize);
 
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            if (selection.nBlockSize + nPackageSize >= nBlockMaxSize) {
+                setFailed.insert(hash);
                 continue;
+            }
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
+            // Skip free transactions if we're past the minimum block size.
+            // Packages come best first, so none of the rest pay either.
+            if (packageRate < ::minRelayTxFee && (selection.nBlockSize + nPackageSize >= nBlockMinSize))
+                break;
 
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
+            // The package is the transaction plus its ancestors not in the block yet
+            set<uint256> setAncestors;
+            mempool.CalculateAncestors(entry.GetTx(), setAncestors);
+            vector<const CTxMemPoolEntry*> vPackage;
+            bool fAncestorFailed = false;
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (selection.setInBlock.count(hashAncestor))
+                    continue;
+                if (setFailed.count(hashAncestor)) {
+                    fAncestorFailed = true;
+                    break;
+                }
+                vPackage.push_back(&mempool.mapTx[hashAncestor]);
+            }
+            if (fAncestorFailed) {
+                setFailed.insert(hash);
+                continue;
             }
+            vPackage.push_back(&entry);
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
+            std::sort(vPackage.begin(), vPackage.end(), CompareByAncestorCount());
+            BOOST_FOREACH (const CTxMemPoolEntry* pentry, vPackage) {
+                if (!selection.TryAdd(*pentry, nBlockMaxSize, pentry->GetPriority(nHeight), packageRate)) {
+                    setFailed.insert(pentry->GetTx().GetHash());
+                    setFailed.insert(hash);
+                    break;
                 }
             }
         }
 
+        nFees = selection.nFees;
+        uint64_t nBlockTx = selection.nBlockTx;
+        uint64_t nBlockSize = selection.nBlockSize;
+
         if (!fProofOfStake) {
             //Servicenode and general budget payments
             FillBlockPayee(txNew, nFees, fProofOfStake);
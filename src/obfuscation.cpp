@@ -17,6 +17,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
 
 #include <algorithm>
 #include <boost/assign/list_of.hpp>
@@ -2101,19 +2103,86 @@ std::string CObfuscationPool::GetMessageByID(int messageID)
     }
 }
 
-bool CObfuScationSigner::IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey)
+/** Upper bound on cached collateral outpoints, well above the size of the servicenode list */
+static const unsigned int MAX_COLLATERAL_CACHE_SIZE = 20000;
+
+bool CServicenodeCollateralCache::Get(const COutPoint& outpoint, const CKeyID& keyID) const
+{
+    LOCK(cs);
+    std::map<COutPoint, CKeyID>::const_iterator it = mapVerified.find(outpoint);
+    return it != mapVerified.end() && it->second == keyID;
+}
+
+void CServicenodeCollateralCache::Set(const COutPoint& outpoint, const CKeyID& keyID)
+{
+    LOCK(cs);
+    if (mapVerified.size() >= MAX_COLLATERAL_CACHE_SIZE)
+        mapVerified.clear();
+    mapVerified[outpoint] = keyID;
+}
+
+void CServicenodeCollateralCache::BlockConnected(const CBlock& block)
 {
+    LOCK(cs);
+    if (mapVerified.empty())
+        return;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin)
+            mapVerified.erase(txin.prevout);
+    }
+}
+
+void CServicenodeCollateralCache::BlockDisconnected(const CBlock& block)
+{
+    LOCK(cs);
+    if (mapVerified.empty())
+        return;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        const uint256 hash = tx.GetHash();
+        std::map<COutPoint, CKeyID>::iterator it = mapVerified.lower_bound(COutPoint(hash, 0));
+        while (it != mapVerified.end() && it->first.hash == hash)
+            mapVerified.erase(it++);
+    }
+}
+
+void CServicenodeCollateralCache::Clear()
+{
+    LOCK(cs);
+    mapVerified.clear();
+}
+
+CServicenodeCollateralCache servicenodeCollateralCache;
+
+bool CObfuScationSigner::IsVinAssociatedWithPubkey(const CTxIn& vin, const CPubKey& pubkey)
+{
+    const CKeyID keyID = pubkey.GetID();
+    if (servicenodeCollateralCache.Get(vin.prevout, keyID))
+        return true;
+
     CScript payee2;
-    payee2 = GetScriptForDestination(pubkey.GetID());
+    payee2 = GetScriptForDestination(keyID);
 
+    {
+        LOCK(cs_main);
+        const CCoins* coins = pcoinsTip->AccessCoins(vin.prevout.hash);
+        if (coins && coins->IsAvailable(vin.prevout.n)) {
+            const CTxOut& out = coins->vout[vin.prevout.n];
+            if (out.nValue != SERVICENODE_REQUIRED_AMOUNT * COIN || out.scriptPubKey != payee2)
+                return false;
+            servicenodeCollateralCache.Set(vin.prevout, keyID);
+            return true;
+        }
+    }
+
+    // Not an unspent output of the active chain (mempool or already spent),
+    // look at the transaction itself; the result is not cached
     CTransaction txVin;
     uint256 hash;
-    if (GetTransaction(vin.prevout.hash, txVin, hash, true)) {
-        BOOST_FOREACH (CTxOut out, txVin.vout) {
-            if (out.nValue == SERVICENODE_REQUIRED_AMOUNT * COIN) {
-                if (out.scriptPubKey == payee2) return true;
-            }
-        }
+    if (GetTransaction(vin.prevout.hash, txVin, hash, true) && vin.prevout.n < txVin.vout.size()) {
+        const CTxOut& out = txVin.vout[vin.prevout.n];
+        return out.nValue == SERVICENODE_REQUIRED_AMOUNT * COIN && out.scriptPubKey == payee2;
     }
 
     return false;
@@ -2161,14 +2230,64 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
+namespace {
+
+/**
+ * Messages whose compact signature has already been recovered to the expected
+ * key. Servicenode, budget and payment votes are seen several times (relayed,
+ * synced, re-checked), this keeps each from going through key recovery again.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! sigdata_type is (message hash, signature, key id):
+    typedef boost::tuple<uint256, std::vector<unsigned char>, CKeyID> sigdata_type;
+    std::set<sigdata_type> setValid;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.count(sigdata_type(hash, vchSig, keyID)) > 0;
+    }
+
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize) {
+            // Evict a random entry, see CSignatureCache
+            std::vector<unsigned char> unused;
+            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(GetRandHash(), unused, CKeyID()));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(sigdata_type(hash, vchSig, keyID));
+    }
+};
+
+CMessageSignatureCache messageSignatureCache;
+
+}
+
 bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hash = ss.GetHash();
+
+    if (messageSignatureCache.Get(hash, vchSig, pubkey.GetID()))
+        return true;
 
     CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    if (!pubkey2.RecoverCompact(hash, vchSig)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
@@ -2176,7 +2295,11 @@ bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vc
     if (fDebug && pubkey2.GetID() != pubkey.GetID())
         LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    if (pubkey2.GetID() != pubkey.GetID())
+        return false;
+
+    messageSignatureCache.Set(hash, vchSig, pubkey2.GetID());
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
@@ -21,6 +21,7 @@ class CServiceNodeVote;
 class CBitcoinAddress;
 class CObfuscationQueue;
 class CObfuscationBroadcastTx;
+class CServicenodeCollateralCache;
 class CActiveServicenode;
 
 // pool states for mixing
@@ -52,6 +53,7 @@ static const int64_t OBFUSCATION_POOL_MAX = (99999.99 * COIN);
 
 extern CObfuscationPool obfuScationPool;
 extern CObfuScationSigner obfuScationSigner;
+extern CServicenodeCollateralCache servicenodeCollateralCache;
 extern std::vector<CObfuscationQueue> vecObfuscationQueue;
 extern std::string strServiceNodePrivKey;
 extern map<uint256, CObfuscationBroadcastTx> mapObfuscationBroadcastTxes;
@@ -243,13 +245,32 @@ public:
     int64_t sigTime;
 };
 
+/** Collateral outpoints already verified against the UTXO set, with the key they pay to.
+ *  Entries are dropped when the outpoint gets spent or its transaction is disconnected.
+ */
+class CServicenodeCollateralCache
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CKeyID> mapVerified;
+
+public:
+    bool Get(const COutPoint& outpoint, const CKeyID& keyID) const;
+    void Set(const COutPoint& outpoint, const CKeyID& keyID);
+    /// Forget the collateral spent by the block's transactions
+    void BlockConnected(const CBlock& block);
+    /// Forget the collateral created by the block's transactions
+    void BlockDisconnected(const CBlock& block);
+    void Clear();
+};
+
 /** Helper object for signing and checking signatures
  */
 class CObfuScationSigner
 {
 public:
-    /// Is the inputs associated with this public key? (and there is 5000 BLOCK - checking if valid servicenode)
-    bool IsVinAssociatedWithPubkey(CTxIn& vin, CPubKey& pubkey);
+    /// Is the input associated with this public key? (pays 5000 BLOCK to it - checking if valid servicenode)
+    bool IsVinAssociatedWithPubkey(const CTxIn& vin, const CPubKey& pubkey);
     /// Set the private/public key values, returns true if successful
     bool GetKeysFromSecret(std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet);
     /// Set the private/public key values, returns true if successful
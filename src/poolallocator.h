@@ -0,0 +1,183 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POOLALLOCATOR_H
+#define BITCOIN_POOLALLOCATOR_H
+
+#include <new>
+#include <utility>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Arena for objects of one size. Memory is taken from the system in growing
+ * blocks and recycled through a free list, so containers with millions of
+ * small nodes (like the coins cache) neither pay a malloc header per node nor
+ * fragment the heap. All blocks are returned once the last object is freed.
+ * Not thread safe; the owner's lock covers it.
+ */
+class CObjectPool
+{
+private:
+    // Disallow copies, allocators keep pointers to the pool
+    CObjectPool(const CObjectPool&);
+    CObjectPool& operator=(const CObjectPool&);
+
+    size_t nRequestedSize; //!< 0 until the first allocation fixes it
+    size_t nObjectSize;    //!< nRequestedSize rounded up to the alignment
+    size_t nNextBlockObjects;
+    std::vector<void*> vBlocks;
+    void* pFree;
+    char* pNext;
+    char* pEnd;
+    size_t nBytesAllocated;
+    size_t nObjectsInUse;
+
+    void AddBlock()
+    {
+        size_t nBytes = nNextBlockObjects * nObjectSize;
+        char* pBlock = static_cast<char*>(::operator new(nBytes));
+        vBlocks.push_back(pBlock);
+        pNext = pBlock;
+        pEnd = pBlock + nBytes;
+        nBytesAllocated += nBytes;
+        if (nNextBlockObjects < MAX_BLOCK_OBJECTS)
+            nNextBlockObjects *= 2;
+    }
+
+    void Release()
+    {
+        for (unsigned int i = 0; i < vBlocks.size(); i++)
+            ::operator delete(vBlocks[i]);
+        std::vector<void*>().swap(vBlocks);
+        pFree = NULL;
+        pNext = pEnd = NULL;
+        nBytesAllocated = 0;
+        nNextBlockObjects = MIN_BLOCK_OBJECTS;
+    }
+
+public:
+    static const size_t MIN_BLOCK_OBJECTS = 64;
+    static const size_t MAX_BLOCK_OBJECTS = 16384;
+
+    CObjectPool() : nRequestedSize(0), nObjectSize(0), nNextBlockObjects(MIN_BLOCK_OBJECTS), pFree(NULL), pNext(NULL), pEnd(NULL), nBytesAllocated(0), nObjectsInUse(0) {}
+    ~CObjectPool() { Release(); }
+
+    /** Whether objects of nSize bytes come from this pool. The first size asked for is the one served. */
+    bool Serves(size_t nSize)
+    {
+        if (nRequestedSize == 0 && nSize > 0) {
+            // Round up so every object stays aligned and can hold the free list link
+            const size_t nAlign = 2 * sizeof(void*);
+            nRequestedSize = nSize;
+            nObjectSize = (nSize + nAlign - 1) / nAlign * nAlign;
+        }
+        return nSize == nRequestedSize;
+    }
+
+    /** Whether an object of nSize bytes being freed was handed out by this pool */
+    bool Owns(size_t nSize) const { return nRequestedSize != 0 && nSize == nRequestedSize; }
+
+    void* Allocate()
+    {
+        void* p;
+        if (pFree) {
+            p = pFree;
+            pFree = *static_cast<void**>(pFree);
+        } else {
+            if (pNext == pEnd)
+                AddBlock();
+            p = pNext;
+            pNext += nObjectSize;
+        }
+        nObjectsInUse++;
+        return p;
+    }
+
+    void Deallocate(void* p)
+    {
+        *static_cast<void**>(p) = pFree;
+        pFree = p;
+        if (--nObjectsInUse == 0)
+            Release();
+    }
+
+    /** Bytes taken from the system, whether handed out or not */
+    size_t BytesAllocated() const { return nBytesAllocated; }
+    size_t ObjectsInUse() const { return nObjectsInUse; }
+};
+
+/**
+ * STL allocator that serves single object allocations of its pool's size from
+ * a CObjectPool and everything else (e.g. hash table bucket arrays) from the heap.
+ */
+template <typename T>
+class pool_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U> other;
+    };
+
+    CObjectPool* pool;
+
+    pool_allocator() : pool(NULL) {}
+    explicit pool_allocator(CObjectPool* poolIn) : pool(poolIn) {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U>& a) : pool(a.pool) {}
+
+    T* allocate(size_t n, const void* hint = 0)
+    {
+        if (n == 1 && pool && pool->Serves(sizeof(T)))
+            return static_cast<T*>(pool->Allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n == 1 && pool && pool->Owns(sizeof(T)))
+            pool->Deallocate(p);
+        else
+            ::operator delete(p);
+    }
+
+    size_t max_size() const { return size_t(-1) / sizeof(T); }
+    T* address(T& x) const { return &x; }
+    const T* address(const T& x) const { return &x; }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new ((void*)p) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U* p)
+    {
+        p->~U();
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const pool_allocator<T>& a, const pool_allocator<U>& b)
+{
+    return a.pool == b.pool;
+}
+
+template <typename T, typename U>
+bool operator!=(const pool_allocator<T>& a, const pool_allocator<U>& b)
+{
+    return a.pool != b.pool;
+}
+
+#endif // BITCOIN_POOLALLOCATOR_H
@@ -43,6 +43,8 @@ public:
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry);
 extern Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONParts(const CBlock& block, const CBlockIndex* blockindex, Object& head, Object& tail);
+extern void blockToJSONStream(const CBlock& block, const Object& head, const Object& tail, bool txDetails, CJSONStreamWriter& writer);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -132,7 +134,25 @@ static bool rest_block(AcceptedConnection* conn,
     }
 
     case RF_JSON: {
-        Object objBlock = blockToJSON(block, pblockindex, showTxDetails);
+        // Blocks with full transaction details can get big, stream them if the client allows it
+        std::ostream* pstream = conn->begin_chunked(HTTP_OK, fRun);
+        if (pstream) {
+            Object head, tail;
+            {
+                LOCK(cs_main);
+                blockToJSONParts(block, pblockindex, head, tail);
+            }
+            CJSONStreamWriter writer(*pstream);
+            blockToJSONStream(block, head, tail, showTxDetails, writer);
+            *pstream << "\n";
+            return true;
+        }
+
+        Object objBlock;
+        {
+            LOCK(cs_main);
+            objBlock = blockToJSON(block, pblockindex, showTxDetails);
+        }
         string strJSON = write_string(Value(objBlock), false) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
         return true;
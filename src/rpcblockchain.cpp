@@ -7,13 +7,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "init.h"
 #include "main.h"
 #include "rpcserver.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 
+#include <boost/scoped_ptr.hpp>
+
 #include "json/json_spirit_value.h"
 
 using namespace json_spirit;
@@ -51,19 +56,41 @@ double GetDifficulty(const CBlockIndex* blockindex)
 }
 
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/**
+ * The members of blockToJSON() before and after "tx". Needs cs_main for
+ * blockindex and chainActive; the transactions can be added without it.
+ */
+void blockToJSONParts(const CBlock& block, const CBlockIndex* blockindex, Object& head, Object& tail)
 {
-    Object result;
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    head.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+    head.push_back(Pair("confirmations", confirmations));
+    head.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    head.push_back(Pair("height", blockindex->nHeight));
+    head.push_back(Pair("version", block.nVersion));
+    head.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+
+    tail.push_back(Pair("time", block.GetBlockTime()));
+    tail.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    tail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    tail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    tail.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+
+    if (blockindex->pprev)
+        tail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    CBlockIndex* pnext = chainActive.Next(blockindex);
+    if (pnext)
+        tail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    Object result;
+    Object tail;
+    blockToJSONParts(block, blockindex, result, tail);
     Array txs;
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
         if (txDetails) {
@@ -74,20 +101,30 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDe
             txs.push_back(tx.GetHash().GetHex());
     }
     result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
-
-    if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex* pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    result.insert(result.end(), tail.begin(), tail.end());
     return result;
 }
 
+/** Same output as blockToJSON(), writing one transaction at a time */
+void blockToJSONStream(const CBlock& block, const Object& head, const Object& tail, bool txDetails, CJSONStreamWriter& writer)
+{
+    writer.BeginObject();
+    writer.WriteMembers(head);
+    writer.Key("tx");
+    writer.BeginArray();
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (txDetails) {
+            Object objTx;
+            TxToJSON(tx, uint256(), objTx);
+            writer.Write(objTx);
+        } else
+            writer.Write(tx.GetHash().GetHex());
+    }
+    writer.EndArray();
+    writer.WriteMembers(tail);
+    writer.EndObject();
+}
+
 
 Object blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
@@ -301,6 +338,44 @@ Value getblock(const Array& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+void getblock_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() < 1 || params.size() > 2)
+        getblock(params, true);
+
+    uint256 hash(params[0].get_str());
+
+    bool fVerbose = true;
+    if (params.size() > 1)
+        fVerbose = params[1].get_bool();
+
+    CBlock block;
+    Object head, tail;
+    {
+        LOCK(cs_main);
+
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+        if (!ReadBlockFromDisk(block, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+        if (fVerbose)
+            blockToJSONParts(block, pblockindex, head, tail);
+    }
+
+    if (!fVerbose) {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        writer.Write(HexStr(ssBlock.begin(), ssBlock.end()));
+        return;
+    }
+
+    blockToJSONStream(block, head, tail, false, writer);
+}
+
 Value getblockheader(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -353,29 +428,68 @@ Value getblockheader(const Array& params, bool fHelp)
 
 Value gettxoutsetinfo(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( scan )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "They are kept up to date as blocks are connected. With scan, or while they are\n"
+            "still being computed after startup, the whole set is walked, which may take some time.\n"
+            "\nArguments:\n"
+            "1. scan    (boolean, optional, default=false) Walk the coin database for the serialized size and hash\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, when walked\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, when walked\n"
+            "  \"hash_muhash\": \"hash\",   (string) Order independent hash of the set, when not walked\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"last_check\": {          (json object, optional) The last -utxostatscheck verification\n"
+            "    \"height\": n,          (numeric) The height it was done at\n"
+            "    \"matched\": true|false (boolean) Whether the statistics were correct\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleRpc("gettxoutsetinfo", ""));
 
     Object ret;
 
+    CUTXOSetStats utxoStats;
+    bool fScan = params.size() > 0 && params[0].get_bool();
+    if (!fScan && utxoStatsTracker.Get(utxoStats)) {
+        uint256 hashMuHash;
+        utxoStats.muhash.Finalize(hashMuHash.begin());
+        ret.push_back(Pair("height", (int64_t)utxoStats.nHeight));
+        ret.push_back(Pair("bestblock", utxoStats.hashBlock.GetHex()));
+        ret.push_back(Pair("transactions", (int64_t)utxoStats.nTransactions));
+        ret.push_back(Pair("txouts", (int64_t)utxoStats.nTransactionOutputs));
+        ret.push_back(Pair("hash_muhash", hashMuHash.GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(utxoStats.nTotalAmount)));
+
+        int nCheckHeight;
+        bool fMatched;
+        if (utxoStatsTracker.GetLastCheck(nCheckHeight, fMatched)) {
+            Object check;
+            check.push_back(Pair("height", nCheckHeight));
+            check.push_back(Pair("matched", fMatched));
+            ret.push_back(Pair("last_check", check));
+        }
+        return ret;
+    }
+
+    // Only the flush and taking the snapshot need cs_main, the walk over the
+    // coin database runs against the snapshot without blocking validation
+    boost::scoped_ptr<CCoinsViewDBSnapshot> pview;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pview.reset(pcoinsdbview->GetSnapshot());
+    }
+
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    if (pview->GetStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
@@ -387,6 +501,113 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
     return ret;
 }
 
+static Object LevelDBInfoToJSON(const CLevelDBWrapper& db, const std::string& strPrefixes)
+{
+    const CLevelDBOptions& dbOptions = db.GetDBOptions();
+    Object options;
+    options.push_back(Pair("cache", (int64_t)db.GetCacheSize()));
+    options.push_back(Pair("maxopenfiles", dbOptions.nMaxOpenFiles));
+    options.push_back(Pair("blocksize", (int64_t)dbOptions.nBlockSize));
+    options.push_back(Pair("writebuffer", (int64_t)dbOptions.nWriteBufferSize));
+    options.push_back(Pair("blockcache", dbOptions.nBlockCacheShare));
+    options.push_back(Pair("compression", dbOptions.fCompression));
+
+    CLevelDBStats stats;
+    db.GetStats(stats);
+    Array files;
+    BOOST_FOREACH (int nFiles, stats.vFilesAtLevel)
+        files.push_back(nFiles);
+    Object sizes;
+    BOOST_FOREACH (char chPrefix, strPrefixes)
+        sizes.push_back(Pair(std::string(1, chPrefix), (int64_t)db.GetApproximateSize(chPrefix)));
+
+    Object ret;
+    ret.push_back(Pair("options", options));
+    ret.push_back(Pair("size", (int64_t)stats.nApproximateSize));
+    ret.push_back(Pair("sizes", sizes));
+    ret.push_back(Pair("memory", (int64_t)stats.nMemoryUsage));
+    ret.push_back(Pair("files", files));
+    ret.push_back(Pair("stats", stats.strStats));
+    return ret;
+}
+
+Value getdbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns tuning and LevelDB statistics of the chainstate and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {         (json object) The coins database\n"
+            "    \"options\": {          (json object) Options the database was opened with\n"
+            "      \"cache\": n,         (numeric) Memory budget in bytes\n"
+            "      \"maxopenfiles\": n,  (numeric) Table files kept open\n"
+            "      \"blocksize\": n,     (numeric) Table block size in bytes\n"
+            "      \"writebuffer\": n,   (numeric) Write buffer size in bytes, 0 if derived from the cache\n"
+            "      \"blockcache\": n,    (numeric) Percentage of the cache used as block cache\n"
+            "      \"compression\": b    (boolean) Whether Snappy compression was asked for\n"
+            "    },\n"
+            "    \"size\": n,            (numeric) Approximate size on disk in bytes\n"
+            "    \"sizes\": {            (json object) Approximate size on disk of the keys of each record type\n"
+            "      \"c\": n,\n"
+            "      ...\n"
+            "    },\n"
+            "    \"memory\": n,          (numeric) Approximate memory used by LevelDB's memtables\n"
+            "    \"files\": [ n, ... ],  (array) Number of table files at each level\n"
+            "    \"stats\": \"...\"        (string) LevelDB's compaction statistics (leveldb.stats)\n"
+            "  },\n"
+            "  \"blockindex\": { ... }   (json object) The block index database, same fields\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") + HelpExampleRpc("getdbstats", ""));
+
+    LOCK(cs_main);
+    Object ret;
+    if (pcoinsdbview)
+        ret.push_back(Pair("chainstate", LevelDBInfoToJSON(pcoinsdbview->GetDB(), "cB")));
+    if (pblocktree)
+        ret.push_back(Pair("blockindex", LevelDBInfoToJSON(*pblocktree, "bfltRF")));
+    return ret;
+}
+
+Value getcoinscacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns memory use and hit rate of the in-memory unspent transaction output cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"transactions\": n,    (numeric) The number of cached transactions\n"
+            "  \"usage\": n,           (numeric) Heap memory used by the cache, in bytes\n"
+            "  \"limit\": n,           (numeric) Usage above which the cache is flushed to disk (-dbcache)\n"
+            "  \"entrybytes\": n,      (numeric) Bytes of the arena holding the cache entries\n"
+            "  \"coinsbytes\": n,      (numeric) Bytes of the outputs and scripts held by the entries\n"
+            "  \"hits\": n,            (numeric) Lookups answered from the cache\n"
+            "  \"misses\": n,          (numeric) Lookups that went to the database\n"
+            "  \"hitrate\": x.xxx      (numeric) hits / (hits + misses)\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getcoinscacheinfo", "") + HelpExampleRpc("getcoinscacheinfo", ""));
+
+    LOCK(cs_main);
+    CCoinsCacheStats stats;
+    pcoinsTip->GetCacheStats(stats);
+
+    Object ret;
+    ret.push_back(Pair("transactions", (int64_t)stats.nEntries));
+    ret.push_back(Pair("usage", (int64_t)stats.nDynamicUsage));
+    ret.push_back(Pair("limit", (int64_t)nCoinCacheUsage));
+    ret.push_back(Pair("entrybytes", (int64_t)stats.nPoolBytes));
+    ret.push_back(Pair("coinsbytes", (int64_t)stats.nCoinsBytes));
+    ret.push_back(Pair("hits", (int64_t)stats.nHits));
+    ret.push_back(Pair("misses", (int64_t)stats.nMisses));
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+    ret.push_back(Pair("hitrate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    return ret;
+}
+
 Value gettxout(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
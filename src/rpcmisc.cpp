@@ -9,6 +9,7 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
+#include "kernel.h"
 #include "main.h"
 #include "servicenode-sync.h"
 #include "net.h"
@@ -496,6 +497,8 @@ Value getstakingstatus(const Array & params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if servicenode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"kernelspersecond\": x.xxx,        (numeric) stake kernel hashes per second in the last search\n"
+            "  \"kernelsearchtime\": n,            (numeric) duration of the last stake kernel search in milliseconds\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -518,6 +521,12 @@ Value getstakingstatus(const Array & params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    double dKernelsPerSecond = 0;
+    int64_t nSearchMillis = 0;
+    GetStakeKernelSearchStats(dKernelsPerSecond, nSearchMillis);
+    obj.push_back(Pair("kernelspersecond", dKernelsPerSecond));
+    obj.push_back(Pair("kernelsearchtime", nSearchMillis));
+
     return obj;
 }
 #endif // ENABLE_WALLET
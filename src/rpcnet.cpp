@@ -18,6 +18,9 @@
 #include "version.h"
 #include "activeservicenode.h"
 #include "xbridge/xbridgeapp.h"
+#if ENABLE_ZMQ
+#include "zmq/zmqpublishnotifier.h"
+#endif
 
 #include <boost/foreach.hpp>
 
@@ -398,7 +401,8 @@ Value getnetworkinfo(const Array& params, bool fHelp)
             "    \"score\": xxx                         (numeric) relative score\n"
             "  }\n"
             "  ,...\n"
-            "  ]\n"
+            "  ],\n"
+            "  \"zmqdropped\": xxx                       (numeric) ZMQ notifications that were dropped instead of published (only with ZMQ support)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnetworkinfo", "") + HelpExampleRpc("getnetworkinfo", ""));
@@ -425,6 +429,9 @@ Value getnetworkinfo(const Array& params, bool fHelp)
         }
     }
     obj.push_back(Pair("localaddresses", localAddresses));
+#if ENABLE_ZMQ
+    obj.push_back(Pair("zmqdropped", CZMQAbstractPublishNotifier::GetDroppedMessages()));
+#endif
     return obj;
 }
 
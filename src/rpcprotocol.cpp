@@ -128,6 +128,24 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         FormatFullVersion());
 }
 
+string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType)
+{
+    return strprintf(
+        "HTTP/1.1 %d %s\r\n"
+        "Date: %s\r\n"
+        "Connection: %s\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Content-Type: %s\r\n"
+        "Server: blocknetdx-json-rpc/%s\r\n"
+        "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
+        FormatFullVersion());
+}
+
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive, bool headersOnly, const char* contentType)
 {
     if (headersOnly) {
@@ -292,3 +310,65 @@ Object JSONRPCError(int code, const string& message)
     error.push_back(Pair("message", message));
     return error;
 }
+
+void CJSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            stream << ',';
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    stream << '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    stream << '}';
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    stream << '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    stream << ']';
+}
+
+void CJSONStreamWriter::Key(const std::string& strKey)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    BeginValue();
+    write_stream(Value(strKey), stream);
+    stream << ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Write(const Value& value)
+{
+    BeginValue();
+    write_stream(value, stream);
+}
+
+void CJSONStreamWriter::WriteMembers(const Object& obj)
+{
+    BOOST_FOREACH (const Pair& pair, obj)
+        Write(pair.name_, pair.value_);
+}
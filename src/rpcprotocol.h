@@ -10,8 +10,10 @@
 
 #include <list>
 #include <map>
+#include <ostream>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "json/json_spirit_reader_template.h"
 #include "json/json_spirit_utils.h"
@@ -78,6 +80,7 @@ std::string HTTPPost(const std::string& strMsg, const std::map<std::string, std:
 std::string HTTPError(int nStatus, bool keepalive, bool headerOnly = false);
 std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const char* contentType = "application/json");
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive, bool headerOnly = false, const char* contentType = "application/json");
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char* contentType = "application/json");
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int& proto, std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int& proto);
 int ReadHTTPHeaders(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet);
@@ -87,4 +90,39 @@ json_spirit::Object JSONRPCReplyObj(const json_spirit::Value& result, const json
 std::string JSONRPCReply(const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
+/**
+ * Writes a JSON document to a stream piece by piece, so large results don't
+ * need to be built as one json_spirit tree first. The output is the same as
+ * write_string() of the equivalent tree.
+ */
+class CJSONStreamWriter
+{
+public:
+    CJSONStreamWriter(std::ostream& streamIn) : stream(streamIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Name the next member of the current object */
+    void Key(const std::string& strKey);
+    /** Write a complete value: an array element, a member value or the whole document */
+    void Write(const json_spirit::Value& value);
+    void Write(const std::string& strKey, const json_spirit::Value& value)
+    {
+        Key(strKey);
+        Write(value);
+    }
+    /** Write every member of obj into the current object */
+    void WriteMembers(const json_spirit::Object& obj);
+
+private:
+    std::ostream& stream;
+    std::vector<bool> vEmpty; //!< per open object/array: nothing written into it yet
+    bool fAfterKey;
+
+    void BeginValue();
+};
+
 #endif // BITCOIN_RPCPROTOCOL_H
@@ -286,6 +286,100 @@ Value getrawtransaction(const Array& params, bool fHelp)
 }
 
 #ifdef ENABLE_WALLET
+static void ParseListUnspentParams(const Array& params, int& nMinDepth, int& nMaxDepth, set<CBitcoinAddress>& setAddress)
+{
+    nMinDepth = 1;
+    if (params.size() > 0)
+        nMinDepth = params[0].get_int();
+
+    nMaxDepth = 9999999;
+    if (params.size() > 1)
+        nMaxDepth = params[1].get_int();
+
+    if (params.size() > 2) {
+        Array inputs = params[2].get_array();
+        BOOST_FOREACH (Value& input, inputs) {
+            CBitcoinAddress address(input.get_str());
+            if (!address.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid BlocknetDX address: ") + input.get_str());
+            if (setAddress.count(address))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated address: ") + input.get_str());
+            setAddress.insert(address);
+        }
+    }
+}
+
+/** What listunspent reports of a COutput, which points into mapWallet and is only valid under cs_wallet */
+struct UnspentOutput {
+    uint256 txid;
+    int i;
+    CTxOut txout;
+    int nDepth;
+    bool fSpendable;
+};
+
+static void GetUnspentOutputs(vector<UnspentOutput>& vUnspent)
+{
+    assert(pwalletMain != NULL);
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    vector<COutput> vecOutputs;
+    pwalletMain->AvailableCoins(vecOutputs, false);
+    vUnspent.resize(vecOutputs.size());
+    for (unsigned int n = 0; n < vecOutputs.size(); n++) {
+        const COutput& out = vecOutputs[n];
+        vUnspent[n].txid = out.tx->GetHash();
+        vUnspent[n].i = out.i;
+        vUnspent[n].txout = out.tx->vout[out.i];
+        vUnspent[n].nDepth = out.nDepth;
+        vUnspent[n].fSpendable = out.fSpendable;
+    }
+}
+
+/** Fill entry with the listunspent fields of out; false if the filters exclude it */
+static bool UnspentToJSON(const UnspentOutput& out, int nMinDepth, int nMaxDepth, const set<CBitcoinAddress>& setAddress, Object& entry)
+{
+    if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+        return false;
+
+    if (setAddress.size()) {
+        CTxDestination address;
+        if (!ExtractDestination(out.txout.scriptPubKey, address))
+            return false;
+
+        if (!setAddress.count(address))
+            return false;
+    }
+
+    CAmount nValue = out.txout.nValue;
+    const CScript& pk = out.txout.scriptPubKey;
+    entry.push_back(Pair("txid", out.txid.GetHex()));
+    entry.push_back(Pair("vout", out.i));
+    CTxDestination address;
+
+    {
+    LOCK(pwalletMain->cs_wallet);
+    if (ExtractDestination(out.txout.scriptPubKey, address)) {
+        entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+        if (pwalletMain->mapAddressBook.count(address))
+            entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+    }
+    }
+    entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+    if (pk.IsPayToScriptHash()) {
+        CTxDestination address;
+        if (ExtractDestination(pk, address)) {
+            const CScriptID& hash = boost::get<CScriptID>(address);
+            CScript redeemScript;
+            if (pwalletMain->GetCScript(hash, redeemScript))
+                entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
+        }
+    }
+    entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+    entry.push_back(Pair("confirmations", out.nDepth));
+    entry.push_back(Pair("spendable", out.fSpendable));
+    return true;
+}
+
 Value listunspent(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
@@ -323,76 +417,44 @@ Value listunspent(const Array& params, bool fHelp)
 
     RPCTypeCheck(params, list_of(int_type)(int_type)(array_type));
 
-    int nMinDepth = 1;
-    if (params.size() > 0)
-        nMinDepth = params[0].get_int();
-
-    int nMaxDepth = 9999999;
-    if (params.size() > 1)
-        nMaxDepth = params[1].get_int();
-
+    int nMinDepth, nMaxDepth;
     set<CBitcoinAddress> setAddress;
-    if (params.size() > 2) {
-        Array inputs = params[2].get_array();
-        BOOST_FOREACH (Value& input, inputs) {
-            CBitcoinAddress address(input.get_str());
-            if (!address.IsValid())
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid BlocknetDX address: ") + input.get_str());
-            if (setAddress.count(address))
-                throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated address: ") + input.get_str());
-            setAddress.insert(address);
-        }
-    }
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
 
     Array results;
-    vector<COutput> vecOutputs;
-    assert(pwalletMain != NULL);
-    pwalletMain->AvailableCoins(vecOutputs, false);
-    BOOST_FOREACH (const COutput& out, vecOutputs) {
-        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
-            continue;
+    vector<UnspentOutput> vUnspent;
+    GetUnspentOutputs(vUnspent);
+    BOOST_FOREACH (const UnspentOutput& out, vUnspent) {
+        Object entry;
+        if (UnspentToJSON(out, nMinDepth, nMaxDepth, setAddress, entry))
+            results.push_back(entry);
+    }
 
-        if (setAddress.size()) {
-            CTxDestination address;
-            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                continue;
+    return results;
+}
 
-            if (!setAddress.count(address))
-                continue;
-        }
+void listunspent_stream(const Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() > 3)
+        listunspent(params, true);
 
-        CAmount nValue = out.tx->vout[out.i].nValue;
-        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-        Object entry;
-        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-        entry.push_back(Pair("vout", out.i));
-        CTxDestination address;
+    RPCTypeCheck(params, list_of(int_type)(int_type)(array_type));
 
-        {
-        LOCK(pwalletMain->cs_wallet);
-        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-            if (pwalletMain->mapAddressBook.count(address))
-                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
-        }
-        }
-        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-        if (pk.IsPayToScriptHash()) {
-            CTxDestination address;
-            if (ExtractDestination(pk, address)) {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwalletMain->GetCScript(hash, redeemScript))
-                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
-            }
-        }
-        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-        entry.push_back(Pair("confirmations", out.nDepth));
-        entry.push_back(Pair("spendable", out.fSpendable));
-        results.push_back(entry);
-    }
+    int nMinDepth, nMaxDepth;
+    set<CBitcoinAddress> setAddress;
+    ParseListUnspentParams(params, nMinDepth, nMaxDepth, setAddress);
 
-    return results;
+    // The wallet isn't locked while the client reads
+    vector<UnspentOutput> vUnspent;
+    GetUnspentOutputs(vUnspent);
+
+    writer.BeginArray();
+    BOOST_FOREACH (const UnspentOutput& out, vUnspent) {
+        Object entry;
+        if (UnspentToJSON(out, nMinDepth, nMaxDepth, setAddress, entry))
+            writer.Write(entry);
+    }
+    writer.EndArray();
 }
 #endif
 
@@ -22,12 +22,14 @@
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace boost;
@@ -44,10 +46,19 @@ static CCriticalSection cs_rpcWarmup;
 
 //! These are created by StartRPCThreads, destroyed in StopRPCThreads
 static asio::io_service* rpc_io_service = NULL;
-static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
 static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
-static boost::asio::io_service::work* rpc_dummy_work = NULL;
+//! RPCRunLater timers run apart from the connections, their callbacks may take cs_main or cs_wallet
+static asio::io_service* rpc_timer_service = NULL;
+static asio::io_service::work* rpc_timer_work = NULL;
+static boost::thread* rpc_timer_thread = NULL;
+static map<string, boost::shared_ptr<deadline_timer> > deadlineTimers;
+static CCriticalSection cs_deadlineTimers;
+class HTTPWorkQueue;
+static HTTPWorkQueue* rpc_work_queue = NULL;
+static asio::io_service* rpc_batch_service = NULL;
+static asio::io_service::work* rpc_batch_work = NULL;
+static boost::thread_group* rpc_batch_group = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector<boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
 
@@ -200,6 +211,63 @@ string CRPCTable::help(string strCommand) const
     return strRet;
 }
 
+/** Time non thread safe RPC calls spent waiting for cs_main (and cs_wallet) */
+struct CRPCLockWaitStats {
+    uint64_t nCalls;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+
+    CRPCLockWaitStats() : nCalls(0), nTotalMicros(0), nMaxMicros(0) {}
+};
+
+static CCriticalSection cs_rpcLockWait;
+static std::map<std::string, CRPCLockWaitStats> mapRPCLockWait;
+
+static void RecordRPCLockWait(const std::string& strMethod, int64_t nMicros)
+{
+    if (nMicros >= 1000000)
+        LogPrint("rpc", "%s waited %.3fs for cs_main\n", strMethod, nMicros * 0.000001);
+
+    LOCK(cs_rpcLockWait);
+    CRPCLockWaitStats& stats = mapRPCLockWait[strMethod];
+    stats.nCalls++;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+}
+
+Value getrpclockstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpclockstats\n"
+            "\nReturns how long non thread safe RPC calls waited for the chain and wallet locks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\": {          (json object) one entry per method called since startup\n"
+            "    \"calls\": n,        (numeric) number of calls\n"
+            "    \"total_ms\": n,     (numeric) total time spent waiting in milliseconds\n"
+            "    \"avg_ms\": n,       (numeric) average wait per call in milliseconds\n"
+            "    \"max_ms\": n        (numeric) longest wait in milliseconds\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpclockstats", "") + HelpExampleRpc("getrpclockstats", ""));
+
+    Object ret;
+    LOCK(cs_rpcLockWait);
+    for (std::map<std::string, CRPCLockWaitStats>::const_iterator it = mapRPCLockWait.begin(); it != mapRPCLockWait.end(); ++it) {
+        const CRPCLockWaitStats& stats = it->second;
+        Object obj;
+        obj.push_back(Pair("calls", (uint64_t)stats.nCalls));
+        obj.push_back(Pair("total_ms", stats.nTotalMicros * 0.001));
+        obj.push_back(Pair("avg_ms", stats.nCalls ? stats.nTotalMicros * 0.001 / stats.nCalls : 0.0));
+        obj.push_back(Pair("max_ms", stats.nMaxMicros * 0.001));
+        ret.push_back(Pair(it->first, obj));
+    }
+    return ret;
+}
+
 Value help(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -237,153 +305,158 @@ Value stop(const Array& params, bool fHelp)
  */
 static const CRPCCommand vRPCCommands[] =
     {
-        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet
-        //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
+        //  category              name                      actor (function)         okSafeMode threadSafe reqWallet streamActor
+        //  --------------------- ------------------------  -----------------------  ---------- ---------- --------- -----------
         /* Overall control/query calls */
-        {"control", "getinfo", &getinfo, true, true, false}, /* uses wallet if enabled */
-        {"control", "help", &help, true, true, false},
-        {"control", "stop", &stop, true, true, false},
+        {"control", "getinfo", &getinfo, true, true, false, NULL}, /* uses wallet if enabled */
+        {"control", "getrpclockstats", &getrpclockstats, true, true, false, NULL},
+        {"control", "help", &help, true, true, false, NULL},
+        {"control", "stop", &stop, true, true, false, NULL},
 
         /* P2P networking */
-        {"network", "getnetworkinfo", &getnetworkinfo, true, true, false},
-        {"network", "addnode", &addnode, true, true, false},
-        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
-        {"network", "getconnectioncount", &getconnectioncount, true, false, false},
-        {"network", "getnettotals", &getnettotals, true, true, false},
-        {"network", "getpeerinfo", &getpeerinfo, true, false, false},
-        {"network", "ping", &ping, true, false, false},
-        {"network", "sendserviceping", &sendserviceping, true, true, false},
-        {"network", "disconnectpeer", &disconnectpeer, true, true, false},
+        {"network", "getnetworkinfo", &getnetworkinfo, true, true, false, NULL},
+        {"network", "addnode", &addnode, true, true, false, NULL},
+        {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false, NULL},
+        {"network", "getconnectioncount", &getconnectioncount, true, false, false, NULL},
+        {"network", "getnettotals", &getnettotals, true, true, false, NULL},
+        {"network", "getpeerinfo", &getpeerinfo, true, false, false, NULL},
+        {"network", "ping", &ping, true, false, false, NULL},
+        {"network", "sendserviceping", &sendserviceping, true, true, false, NULL},
+        {"network", "disconnectpeer", &disconnectpeer, true, true, false, NULL},
 
         /* Block chain and UTXO */
-        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, true, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, true, false},
-        {"blockchain", "getblock", &getblock, true, true, false},
-        {"blockchain", "getblockhash", &getblockhash, true, true, false},
-        {"blockchain", "getblockheader", &getblockheader, false, false, false},
-        {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
-        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
-        {"blockchain", "getrawmempool", &getrawmempool, true, true, false},
-        {"blockchain", "gettxout", &gettxout, true, true, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
-        {"blockchain", "verifychain", &verifychain, true, false, false},
-        {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
-        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
+        {"blockchain", "getblockchaininfo", &getblockchaininfo, true, true, false, NULL},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false, NULL},
+        {"blockchain", "getblockcount", &getblockcount, true, true, false, NULL},
+        {"blockchain", "getblock", &getblock, true, true, false, &getblock_stream},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false, NULL},
+        {"blockchain", "getblockheader", &getblockheader, false, false, false, NULL},
+        {"blockchain", "getchaintips", &getchaintips, true, false, false, NULL},
+        {"blockchain", "getdifficulty", &getdifficulty, true, false, false, NULL},
+        {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false, NULL},
+        {"blockchain", "getrawmempool", &getrawmempool, true, true, false, NULL},
+        {"blockchain", "gettxout", &gettxout, true, true, false, NULL},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, true, false, NULL},
+        {"blockchain", "getcoinscacheinfo", &getcoinscacheinfo, true, false, false, NULL},
+        {"blockchain", "getdbstats", &getdbstats, true, false, false, NULL},
+        {"blockchain", "verifychain", &verifychain, true, false, false, NULL},
+        {"blockchain", "invalidateblock", &invalidateblock, true, true, false, NULL},
+        {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false, NULL},
 
         /* Mining */
-        {"mining", "getblocktemplate", &getblocktemplate, true, false, false},
-        {"mining", "getmininginfo", &getmininginfo, true, false, false},
-        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false},
-        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false},
-        {"mining", "submitblock", &submitblock, true, true, false},
-        {"mining", "reservebalance", &reservebalance, true, true, false},
+        {"mining", "getblocktemplate", &getblocktemplate, true, false, false, NULL},
+        {"mining", "getmininginfo", &getmininginfo, true, false, false, NULL},
+        {"mining", "getnetworkhashps", &getnetworkhashps, true, false, false, NULL},
+        {"mining", "prioritisetransaction", &prioritisetransaction, true, false, false, NULL},
+        {"mining", "submitblock", &submitblock, true, true, false, NULL},
+        {"mining", "reservebalance", &reservebalance, true, true, false, NULL},
 
 #ifdef ENABLE_WALLET
         /* Coin generation */
-        {"generating", "getgenerate", &getgenerate, true, false, false},
-        {"generating", "gethashespersec", &gethashespersec, true, false, false},
-        {"generating", "setgenerate", &setgenerate, true, true, false},
+        {"generating", "getgenerate", &getgenerate, true, false, false, NULL},
+        {"generating", "gethashespersec", &gethashespersec, true, false, false, NULL},
+        {"generating", "setgenerate", &setgenerate, true, true, false, NULL},
 #endif
 
         /* Raw transactions */
-        {"rawtransactions", "createrawtransaction", &createrawtransaction, true,  true, false},
-        {"rawtransactions", "fundrawtransaction",   &fundrawtransaction,   false, false, false },
-        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true,  true, false},
-        {"rawtransactions", "decodescript",         &decodescript,         true,  false, false},
-        {"rawtransactions", "getrawtransaction",    &getrawtransaction,    true,  true, false},
-        {"rawtransactions", "sendrawtransaction",   &sendrawtransaction,   false, true, false},
-        {"rawtransactions", "signrawtransaction",   &signrawtransaction,   false, true, false}, /* uses wallet if enabled */
+        {"rawtransactions", "createrawtransaction", &createrawtransaction, true,  true, false, NULL},
+        {"rawtransactions", "fundrawtransaction",   &fundrawtransaction,   false, false, false, NULL},
+        {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true,  true, false, NULL},
+        {"rawtransactions", "decodescript",         &decodescript,         true,  false, false, NULL},
+        {"rawtransactions", "getrawtransaction",    &getrawtransaction,    true,  true, false, NULL},
+        {"rawtransactions", "sendrawtransaction",   &sendrawtransaction,   false, true, false, NULL},
+        {"rawtransactions", "signrawtransaction",   &signrawtransaction,   false, true, false, NULL}, /* uses wallet if enabled */
 
         /* Utility functions */
-        {"util", "createmultisig", &createmultisig, true, true, false},
-        {"util", "validateaddress", &validateaddress, true, true, false}, /* uses wallet if enabled */
-        {"util", "verifymessage", &verifymessage, true, false, false},
-        {"util", "estimatefee", &estimatefee, true, true, false},
-        {"util", "estimatepriority", &estimatepriority, true, true, false},
+        {"util", "createmultisig", &createmultisig, true, true, false, NULL},
+        {"util", "validateaddress", &validateaddress, true, true, false, NULL}, /* uses wallet if enabled */
+        {"util", "verifymessage", &verifymessage, true, false, false, NULL},
+        {"util", "estimatefee", &estimatefee, true, true, false, NULL},
+        {"util", "estimatepriority", &estimatepriority, true, true, false, NULL},
 
         /* Not shown in help */
-        {"hidden", "invalidateblock", &invalidateblock, true, true, false},
-        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false},
-        {"hidden", "setmocktime", &setmocktime, true, false, false},
+        {"hidden", "invalidateblock", &invalidateblock, true, true, false, NULL},
+        {"hidden", "reconsiderblock", &reconsiderblock, true, true, false, NULL},
+        {"hidden", "setmocktime", &setmocktime, true, false, false, NULL},
 
         /* Blocknetdx features */
-        {"blocknetdx", "servicenode", &servicenode, true, true, false},
-        {"blocknetdx", "servicenodelist", &servicenodelist, true, true, false},
-        {"blocknetdx", "mnbudget", &mnbudget, true, true, false},
-        {"blocknetdx", "mnbudgetvoteraw", &mnbudgetvoteraw, true, true, false},
-        {"blocknetdx", "mnfinalbudget", &mnfinalbudget, true, true, false},
-        {"blocknetdx", "mnsync", &mnsync, true, true, false},
-        {"blocknetdx", "spork", &spork, true, true, false},
+        {"blocknetdx", "servicenode", &servicenode, true, true, false, NULL},
+        {"blocknetdx", "servicenodelist", &servicenodelist, true, true, false, NULL},
+        {"blocknetdx", "mnbudget", &mnbudget, true, true, false, NULL},
+        {"blocknetdx", "mnbudgetvoteraw", &mnbudgetvoteraw, true, true, false, NULL},
+        {"blocknetdx", "mnfinalbudget", &mnfinalbudget, true, true, false, NULL},
+        {"blocknetdx", "mnsync", &mnsync, true, true, false, NULL},
+        {"blocknetdx", "spork", &spork, true, true, false, NULL},
 #ifdef ENABLE_WALLET
-        {"blocknetdx", "obfuscation", &obfuscation, false, false, true}, /* not threadSafe because of SendMoney */
+        {"blocknetdx", "obfuscation", &obfuscation, false, false, true, NULL}, /* not threadSafe because of SendMoney */
 
         /* Wallet */
-        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true},
-        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true},
-        {"wallet", "backupwallet", &backupwallet, true, false, true},
-        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true},
-        {"wallet", "dumpwallet", &dumpwallet, true, false, true},
-        {"wallet", "bip38encrypt", &bip38encrypt, true, false, true},
-        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true},
-        {"wallet", "encryptwallet", &encryptwallet, true, false, true},
-        {"wallet", "getaccountaddress", &getaccountaddress, true, true, true},
-        {"wallet", "getaccount", &getaccount, true, true, true},
-        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, true, true},
-        {"wallet", "getbalance", &getbalance, false, true, true},
-        {"wallet", "getnewaddress", &getnewaddress, true, true, true},
-        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true},
-        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, true, true},
-        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, true, true},
-        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
-        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
-        {"wallet", "gettransaction", &gettransaction, false, true, true},
-        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
-        {"wallet", "getwalletinfo", &getwalletinfo, false, true, true},
-        {"wallet", "importprivkey", &importprivkey, true, false, true},
-        {"wallet", "importwallet", &importwallet, true, false, true},
-        {"wallet", "importaddress", &importaddress, true, false, true},
-        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true},
-        {"wallet", "listaccounts", &listaccounts, false, true, true},
-        {"wallet", "listaddressgroupings", &listaddressgroupings, false, true, true},
-        {"wallet", "listlockunspent", &listlockunspent, false, false, true},
-        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true},
-        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true},
-        {"wallet", "listsinceblock", &listsinceblock, false, true, true},
-        {"wallet", "listtransactions", &listtransactions, false, false, true},
-        {"wallet", "listunspent", &listunspent, false, true, true},
-        {"wallet", "lockunspent", &lockunspent, true, true, true},
-        {"wallet", "move", &movecmd, false, false, true},
-        {"wallet", "multisend", &multisend, false, false, true},
-        {"wallet", "sendfrom", &sendfrom, false, false, true},
-        {"wallet", "sendmany", &sendmany, false, false, true},
-        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true},
-        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true},
-        {"wallet", "setaccount", &setaccount, true, true, true},
-        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, true, true},
-        {"wallet", "settxfee", &settxfee, true, false, true},
-        {"wallet", "signmessage", &signmessage, true, true, true},
-        {"wallet", "walletlock", &walletlock, true, false, true},
-        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true},
-        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true},
-
-        {"xbridge", "dxGetOrderFills",                      &dxGetOrderFills,            false, true, true},
-        {"xbridge", "dxGetOrders",                          &dxGetOrders,                false, true, true},
-        {"xbridge", "dxGetOrder",                           &dxGetOrder,                 false, true, true},
-        {"xbridge", "dxGetLocalTokens",                     &dxGetLocalTokens,           false, true, true},
-        {"xbridge", "dxLoadXBridgeConf",                    &dxLoadXBridgeConf,          false, true, true},
-        {"xbridge", "dxGetNetworkTokens",                   &dxGetNetworkTokens,         false, true, true},
-        {"xbridge", "dxMakeOrder",                          &dxMakeOrder,                false, true, true},
-        {"xbridge", "dxTakeOrder",                          &dxTakeOrder,                false, true, true},
-        {"xbridge", "dxCancelOrder",                        &dxCancelOrder,              false, true, true},
-        {"xbridge", "dxGetOrderHistory",                    &dxGetOrderHistory,          false, true, true},
-        {"xbridge", "dxGetOrderBook",                       &dxGetOrderBook,             false, true, true},
-        {"xbridge", "dxGetTokenBalances",                   &dxGetTokenBalances,         false, true, true},
-        {"xbridge", "dxGetMyOrders",                        &dxGetMyOrders,              false, true, true},
-        {"xbridge", "dxGetLockedUtxos",                     &dxGetLockedUtxos,           false, true, true},
-        {"xbridge", "dxFlushCancelledOrders",               &dxFlushCancelledOrders,     false, true, true},
-        {"xbridge", "gettradingdata",                       &gettradingdata,             false, true, true},
+        {"wallet", "addmultisigaddress", &addmultisigaddress, true, false, true, NULL},
+        {"wallet", "autocombinerewards", &autocombinerewards, false, false, true, NULL},
+        {"wallet", "backupwallet", &backupwallet, true, false, true, NULL},
+        {"wallet", "dumpprivkey", &dumpprivkey, true, false, true, NULL},
+        {"wallet", "dumpwallet", &dumpwallet, true, false, true, NULL},
+        {"wallet", "bip38encrypt", &bip38encrypt, true, false, true, NULL},
+        {"wallet", "bip38decrypt", &bip38decrypt, true, false, true, NULL},
+        {"wallet", "encryptwallet", &encryptwallet, true, false, true, NULL},
+        {"wallet", "getaccountaddress", &getaccountaddress, true, true, true, NULL},
+        {"wallet", "getaccount", &getaccount, true, true, true, NULL},
+        {"wallet", "getaddressesbyaccount", &getaddressesbyaccount, true, true, true, NULL},
+        {"wallet", "getbalance", &getbalance, false, true, true, NULL},
+        {"wallet", "getnewaddress", &getnewaddress, true, true, true, NULL},
+        {"wallet", "getrawchangeaddress", &getrawchangeaddress, true, false, true, NULL},
+        {"wallet", "getreceivedbyaccount", &getreceivedbyaccount, false, true, true, NULL},
+        {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, true, true, NULL},
+        {"wallet", "getstakingstatus", &getstakingstatus, false, false, true, NULL},
+        {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true, NULL},
+        {"wallet", "gettransaction", &gettransaction, false, true, true, NULL},
+        {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true, NULL},
+        {"wallet", "getwalletinfo", &getwalletinfo, false, true, true, NULL},
+        {"wallet", "importprivkey", &importprivkey, true, false, true, NULL},
+        {"wallet", "importwallet", &importwallet, true, false, true, NULL},
+        {"wallet", "importaddress", &importaddress, true, false, true, NULL},
+        {"wallet", "keypoolrefill", &keypoolrefill, true, false, true, NULL},
+        {"wallet", "listaccounts", &listaccounts, false, true, true, NULL},
+        {"wallet", "listaddressgroupings", &listaddressgroupings, false, true, true, NULL},
+        {"wallet", "listlockunspent", &listlockunspent, false, false, true, NULL},
+        {"wallet", "listreceivedbyaccount", &listreceivedbyaccount, false, false, true, NULL},
+        {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false, false, true, NULL},
+        {"wallet", "listsinceblock", &listsinceblock, false, true, true, NULL},
+        {"wallet", "listtransactions", &listtransactions, false, false, true, NULL},
+        {"wallet", "listunspent", &listunspent, false, true, true, &listunspent_stream},
+        {"wallet", "lockunspent", &lockunspent, true, true, true, NULL},
+        {"wallet", "move", &movecmd, false, false, true, NULL},
+        {"wallet", "multisend", &multisend, false, false, true, NULL},
+        {"wallet", "sendfrom", &sendfrom, false, false, true, NULL},
+        {"wallet", "sendmany", &sendmany, false, false, true, NULL},
+        {"wallet", "sendtoaddress", &sendtoaddress, false, false, true, NULL},
+        {"wallet", "sendtoaddressix", &sendtoaddressix, false, false, true, NULL},
+        {"wallet", "setaccount", &setaccount, true, true, true, NULL},
+        {"wallet", "setstakesplitthreshold", &setstakesplitthreshold, false, true, true, NULL},
+        {"wallet", "settxfee", &settxfee, true, false, true, NULL},
+        {"wallet", "signmessage", &signmessage, true, true, true, NULL},
+        {"wallet", "walletlock", &walletlock, true, false, true, NULL},
+        {"wallet", "walletpassphrasechange", &walletpassphrasechange, true, false, true, NULL},
+        {"wallet", "walletpassphrase", &walletpassphrase, true, false, true, NULL},
+
+        /* xbridge: threadSafe, these call out to other coin daemons and must not hold cs_main;
+           xbridge::App locks its own state and takes cs_main only for chain lookups */
+        {"xbridge", "dxGetOrderFills",                      &dxGetOrderFills,            false, true, true, NULL},
+        {"xbridge", "dxGetOrders",                          &dxGetOrders,                false, true, true, NULL},
+        {"xbridge", "dxGetOrder",                           &dxGetOrder,                 false, true, true, NULL},
+        {"xbridge", "dxGetLocalTokens",                     &dxGetLocalTokens,           false, true, true, NULL},
+        {"xbridge", "dxLoadXBridgeConf",                    &dxLoadXBridgeConf,          false, true, true, NULL},
+        {"xbridge", "dxGetNetworkTokens",                   &dxGetNetworkTokens,         false, true, true, NULL},
+        {"xbridge", "dxMakeOrder",                          &dxMakeOrder,                false, true, true, NULL},
+        {"xbridge", "dxTakeOrder",                          &dxTakeOrder,                false, true, true, NULL},
+        {"xbridge", "dxCancelOrder",                        &dxCancelOrder,              false, true, true, NULL},
+        {"xbridge", "dxGetOrderHistory",                    &dxGetOrderHistory,          false, true, true, &dxGetOrderHistory_stream},
+        {"xbridge", "dxGetOrderBook",                       &dxGetOrderBook,             false, true, true, NULL},
+        {"xbridge", "dxGetTokenBalances",                   &dxGetTokenBalances,         false, true, true, NULL},
+        {"xbridge", "dxGetMyOrders",                        &dxGetMyOrders,              false, true, true, NULL},
+        {"xbridge", "dxGetLockedUtxos",                     &dxGetLockedUtxos,           false, true, true, NULL},
+        {"xbridge", "dxFlushCancelledOrders",               &dxFlushCancelledOrders,     false, true, true, NULL},
+        {"xbridge", "gettradingdata",                       &gettradingdata,             false, true, true, NULL},
     #endif // ENABLE_WALLET
 };
 
@@ -457,115 +530,481 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
-template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class HTTPConnection;
+typedef boost::shared_ptr<HTTPConnection> HTTPConnectionRef;
+
+/** A fully read HTTP request waiting for an RPC worker */
+struct HTTPWorkItem {
+    HTTPConnectionRef conn;
+    std::string strURI;
+    std::map<std::string, std::string> mapHeaders;
+    std::string strRequest;
+    int nProto;
+    bool fKeepAlive;
+};
+
+static void ProcessHTTPRequest(HTTPWorkItem& item);
+
+/**
+ * Bounded queue between the HTTP front end and the RPC worker threads.
+ * Requests that don't fit are refused instead of piling up behind slow calls.
+ */
+class HTTPWorkQueue
 {
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<HTTPWorkItem> queue;
+    size_t nMaxDepth;
+    bool fRunning;
+
 public:
-    AcceptedConnectionImpl(asio::io_service& io_service, ssl::context& context, bool fUseSSL) {
-        _stream.expires_from_now(boost::posix_time::seconds(std::numeric_limits<int>::max()));
+    HTTPWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    /** Queue a request; false if the queue is full or shutting down */
+    bool Enqueue(const HTTPWorkItem& item)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(item);
+        cond.notify_one();
+        return true;
+    }
+
+    /** Worker thread loop */
+    void Run()
+    {
+        while (true) {
+            HTTPWorkItem item;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    return;
+                item = queue.front();
+                queue.pop_front();
+            }
+            ProcessHTTPRequest(item);
+        }
+    }
+
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+        cond.notify_all();
     }
+};
+
+static void HTTPWorkerThread(HTTPWorkQueue* queue)
+{
+    RenameThread("blocknetdx-httpworker");
+    queue->Run();
+}
+
+/**
+ * One client connection. Reading, parsing and writing are asynchronous on
+ * rpc_io_service; only complete requests are handed to the worker pool,
+ * so idle keep-alive connections don't tie up a thread.
+ */
+class HTTPConnection : public boost::enable_shared_from_this<HTTPConnection>
+{
+public:
+    ip::tcp::socket socket;
+    ip::tcp::endpoint peer;
+
+    HTTPConnection(asio::io_service& io_serviceIn) : socket(io_serviceIn), io_service(io_serviceIn), timer(io_serviceIn),
+                                                     buf(MAX_SIZE + MAX_HTTP_HEADER_SIZE), nProto(0), nContentLength(0), fClosed(false),
+                                                     fWriting(false), nSendQueued(0), fSendFailed(false) {}
 
-    virtual asio::ip::tcp::iostream & stream() {
-        return _stream;
+    std::string PeerAddress() const { return peer.address().to_string(); }
+
+    /** Start reading requests (I/O thread) */
+    void Start() { ReadRequest(); }
+
+    /** Send strReply, then read the next request or close (any thread) */
+    void Reply(const std::string& strReply, bool fKeepAlive)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(csSend);
+            nSendQueued += strReply.size();
+        }
+        io_service.post(boost::bind(&HTTPConnection::QueueWrite, shared_from_this(), boost::make_shared<std::string>(strReply), true, fKeepAlive));
     }
 
-    virtual std::string peer_address_to_string() const {
-        return peer.address().to_string();
+    /**
+     * Send part of a streamed reply (worker threads). Waits while more than
+     * MAX_SEND_QUEUED bytes are still unsent, so a slow client can't make
+     * the reply pile up in memory. False if the connection is gone.
+     */
+    bool Send(const std::string& strData)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(csSend);
+            while (!fSendFailed && nSendQueued > MAX_SEND_QUEUED) {
+                if (!fRPCRunning)
+                    return false;
+                condSend.timed_wait(lock, boost::posix_time::milliseconds(100));
+            }
+            if (fSendFailed)
+                return false;
+            nSendQueued += strData.size();
+        }
+        io_service.post(boost::bind(&HTTPConnection::QueueWrite, shared_from_this(), boost::make_shared<std::string>(strData), false, true));
+        return true;
     }
 
-    virtual void start() {
-        _stream.expires_from_now(boost::posix_time::seconds(GetArg("-rpctimeout", 30)));
+private:
+    static const size_t MAX_HTTP_HEADER_SIZE = 8192;
+    static const size_t MAX_SEND_QUEUED = 1024 * 1024;
+
+    struct SendItem {
+        boost::shared_ptr<std::string> pData;
+        bool fLast;      //!< end of the reply
+        bool fKeepAlive; //!< read the next request after it
+    };
+
+    asio::io_service& io_service;
+    deadline_timer timer;
+    asio::streambuf buf;
+    int nProto;
+    std::string strMethod;
+    std::string strURI;
+    std::map<std::string, std::string> mapHeaders;
+    size_t nContentLength;
+    bool fClosed;
+
+    // Outgoing data, written one buffer at a time (I/O thread only)
+    std::deque<SendItem> vSendQueue;
+    bool fWriting;
+    // Bytes handed to the connection but not written yet (any thread)
+    boost::mutex csSend;
+    boost::condition_variable condSend;
+    size_t nSendQueued;
+    bool fSendFailed;
+
+    void ReadRequest()
+    {
+        // Idle connections are dropped after -rpctimeout
+        timer.expires_from_now(boost::posix_time::seconds(GetArg("-rpctimeout", 30)));
+        timer.async_wait(boost::bind(&HTTPConnection::HandleTimeout, shared_from_this(), asio::placeholders::error));
+        asio::async_read_until(socket, buf, "\r\n\r\n",
+            boost::bind(&HTTPConnection::HandleHeaders, shared_from_this(), asio::placeholders::error));
     }
 
-    virtual void close() {
-        if (_closed)
+    void HandleHeaders(const boost::system::error_code& error)
+    {
+        if (error || fClosed) {
+            Close();
             return;
-        _closed = true;
-        _stream.close();
+        }
+
+        std::istream is(&buf);
+        mapHeaders.clear();
+        if (!ReadHTTPRequestLine(is, nProto, strMethod, strURI)) {
+            Close();
+            return;
+        }
+        int nLen = ReadHTTPHeaders(is, mapHeaders);
+        if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+            Close();
+            return;
+        }
+        nContentLength = nLen;
+
+        string sConHdr = mapHeaders["connection"];
+        if ((sConHdr != "close") && (sConHdr != "keep-alive"))
+            mapHeaders["connection"] = nProto >= 1 ? "keep-alive" : "close";
+
+        if (buf.size() >= nContentLength) {
+            HandleBody(boost::system::error_code());
+            return;
+        }
+        asio::async_read(socket, buf, asio::transfer_at_least(nContentLength - buf.size()),
+            boost::bind(&HTTPConnection::HandleBody, shared_from_this(), asio::placeholders::error));
+    }
+
+    void HandleBody(const boost::system::error_code& error)
+    {
+        if (error || fClosed) {
+            Close();
+            return;
+        }
+        boost::system::error_code ec;
+        timer.cancel(ec);
+
+        HTTPWorkItem item;
+        item.conn = shared_from_this();
+        item.strURI = strURI;
+        item.mapHeaders.swap(mapHeaders);
+        item.strRequest.resize(nContentLength);
+        if (nContentLength > 0) {
+            std::istream is(&buf);
+            is.read(&item.strRequest[0], nContentLength);
+        }
+        item.nProto = nProto;
+        item.fKeepAlive = (item.mapHeaders["connection"] != "close") && GetBoolArg("-rpckeepalive", true);
+
+        if (!rpc_work_queue || !rpc_work_queue->Enqueue(item)) {
+            LogPrint("rpc", "RPC work queue full, refusing request from %s\n", PeerAddress());
+            QueueWrite(boost::make_shared<std::string>(HTTPError(HTTP_SERVICE_UNAVAILABLE, false)), true, false);
+        }
     }
 
-    virtual bool is_closed() {
-        return _closed;
+    void QueueWrite(boost::shared_ptr<std::string> pData, bool fLast, bool fKeepAlive)
+    {
+        SendItem item;
+        item.pData = pData;
+        item.fLast = fLast;
+        item.fKeepAlive = fKeepAlive;
+        vSendQueue.push_back(item);
+        if (!fWriting)
+            WriteNext();
+    }
+
+    void WriteNext()
+    {
+        if (fClosed || vSendQueue.empty()) {
+            fWriting = false;
+            return;
+        }
+        fWriting = true;
+        asio::async_write(socket, asio::buffer(*vSendQueue.front().pData),
+            boost::bind(&HTTPConnection::HandleWrite, shared_from_this(), asio::placeholders::error));
     }
 
-    typename Protocol::endpoint peer;
+    void HandleWrite(const boost::system::error_code& error)
+    {
+        if (vSendQueue.empty()) {
+            fWriting = false;
+            return;
+        }
+        SendItem item = vSendQueue.front();
+        vSendQueue.pop_front();
+        {
+            boost::unique_lock<boost::mutex> lock(csSend);
+            nSendQueued -= item.pData->size();
+            condSend.notify_all();
+        }
+
+        // Close() left the queue to the write that was in flight
+        if (fClosed) {
+            vSendQueue.clear();
+            fWriting = false;
+            return;
+        }
+        if (error || (item.fLast && (!item.fKeepAlive || !fRPCRunning))) {
+            Close();
+            vSendQueue.clear();
+            fWriting = false;
+            return;
+        }
+        if (item.fLast)
+            ReadRequest();
+        WriteNext();
+    }
+
+    void HandleTimeout(const boost::system::error_code& error)
+    {
+        if (error != asio::error::operation_aborted)
+            Close();
+    }
+
+    void Close()
+    {
+        if (fClosed)
+            return;
+        fClosed = true;
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        socket.shutdown(ip::tcp::socket::shutdown_both, ec);
+        socket.close(ec);
+        // An outstanding write still reads from the front item, HandleWrite drops the queue once it is aborted
+        if (!fWriting)
+            vSendQueue.clear();
+
+        boost::unique_lock<boost::mutex> lock(csSend);
+        fSendFailed = true;
+        condSend.notify_all();
+    }
+};
+
+/** streambuf that passes what is written to it on to the connection as HTTP chunks */
+class HTTPChunkedBuf : public std::streambuf
+{
+public:
+    HTTPChunkedBuf(const HTTPConnectionRef& connIn, const std::string& strHeaderIn) : conn(connIn), strHeader(strHeaderIn), fSent(false), fFailed(false) {}
+
+    /** True once the header and first chunk have been handed to the connection */
+    bool Sent() const { return fSent; }
+
+    /** Send what's left and the terminating chunk */
+    void Finish(bool fKeepAlive)
+    {
+        FlushChunk();
+        std::string strEnd = fSent ? "" : strHeader;
+        strEnd += "0\r\n\r\n";
+        conn->Reply(strEnd, fKeepAlive && !fFailed);
+    }
+
+    /** Drop the connection without completing the reply */
+    void Abort() { conn->Reply("", false); }
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        if (c != traits_type::eof()) {
+            char ch = c;
+            xsputn(&ch, 1);
+        }
+        return fFailed ? traits_type::eof() : traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char* s, std::streamsize n)
+    {
+        if (fFailed)
+            return 0;
+        strPending.append(s, n);
+        if (strPending.size() >= CHUNK_SIZE)
+            FlushChunk();
+        return n;
+    }
 
 private:
-    asio::ip::tcp::iostream _stream;
-    std::atomic<bool> _closed{false};
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    HTTPConnectionRef conn;
+    std::string strHeader;
+    std::string strPending;
+    bool fSent;
+    bool fFailed;
+
+    void FlushChunk()
+    {
+        if (strPending.empty() || fFailed)
+            return;
+        std::string strChunk = fSent ? "" : strHeader;
+        strChunk += strprintf("%x\r\n", strPending.size()) + strPending + "\r\n";
+        strPending.clear();
+        fSent = true;
+        if (!conn->Send(strChunk))
+            fFailed = true;
+    }
 };
 
-void ServiceConnection(AcceptedConnection* conn);
+/**
+ * AcceptedConnection handed to the request handlers on a worker thread.
+ * Replies are collected in memory, or streamed in chunks if the handler asks for that.
+ */
+class HTTPReplyBuffer : public AcceptedConnection
+{
+public:
+    HTTPReplyBuffer(const HTTPConnectionRef& connIn, int nProtoIn) : conn(connIn), nProto(nProtoIn), fClosed(false) {}
+
+    virtual std::iostream& stream() { return ss; }
+    virtual std::string peer_address_to_string() const { return conn->PeerAddress(); }
+    virtual void start() {}
+    virtual void close() { fClosed = true; }
+    virtual bool is_closed() { return fClosed; }
+
+    virtual std::ostream* begin_chunked(int nStatus, bool keepalive, const char* contentType)
+    {
+        // HTTP/1.0 clients don't understand chunked replies
+        if (nProto < 1)
+            return NULL;
+        pchunked.reset(new HTTPChunkedBuf(conn, HTTPReplyHeaderChunked(nStatus, keepalive, contentType)));
+        pchunkedStream.reset(new std::ostream(pchunked.get()));
+        return pchunkedStream.get();
+    }
+
+    virtual bool cancel_chunked()
+    {
+        if (!pchunked)
+            return true;
+        if (pchunked->Sent())
+            return false;
+        pchunkedStream.reset();
+        pchunked.reset();
+        return true;
+    }
+
+    /** Hand the rest of the reply to the connection */
+    void Finish(bool fKeepAlive)
+    {
+        if (!pchunked) {
+            conn->Reply(ss.str(), fKeepAlive);
+        } else if (fClosed) {
+            // Failed half way, the client sees a truncated reply
+            pchunked->Abort();
+        } else {
+            pchunkedStream->flush();
+            pchunked->Finish(fKeepAlive);
+        }
+    }
+
+private:
+    HTTPConnectionRef conn;
+    int nProto;
+    bool fClosed;
+    std::stringstream ss;
+    boost::scoped_ptr<HTTPChunkedBuf> pchunked;
+    boost::scoped_ptr<std::ostream> pchunkedStream;
+};
 
 //! Forward declaration required for RPCListen
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
+static void RPCAcceptHandler(boost::shared_ptr<ip::tcp::acceptor> acceptor,
     bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    HTTPConnectionRef conn,
     const boost::system::error_code& error);
 
 /**
  * Sets up I/O resources to accept and handle a new connection.
  */
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCListen(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
-    const bool fUseSSL)
+static void RPCListen(boost::shared_ptr<ip::tcp::acceptor> acceptor, const bool fUseSSL)
 {
     // Accept connection
-    auto conn = boost::make_shared<AcceptedConnectionImpl<Protocol> >(acceptor->get_io_service(), context, fUseSSL);
+    HTTPConnectionRef conn(new HTTPConnection(*rpc_io_service));
 
     acceptor->async_accept(
-        *conn->stream().rdbuf(),
+        conn->socket,
         conn->peer,
-        boost::bind(&RPCAcceptHandler<Protocol, SocketAcceptorService>,
+        boost::bind(&RPCAcceptHandler,
             acceptor,
-            boost::ref(context),
             fUseSSL,
             conn,
-            _1));
+            asio::placeholders::error));
 }
 
 
 /**
  * Accept and handle incoming connection.
  */
-template <typename Protocol, typename SocketAcceptorService>
-static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
-    ssl::context& context,
+static void RPCAcceptHandler(boost::shared_ptr<ip::tcp::acceptor> acceptor,
     const bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    HTTPConnectionRef conn,
     const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
     if (error != asio::error::operation_aborted && acceptor->is_open())
-        RPCListen(acceptor, context, fUseSSL);
-
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast<AcceptedConnectionImpl<ip::tcp>*>(conn.get());
-    if (!tcp_conn) {
-        LogPrintf("Failed to accept RPC connection: %s\n", __func__);
-        return;
-    }
-
-    // Start processing the connection
-    conn->start();
+        RPCListen(acceptor, fUseSSL);
 
     if (error) {
         // TODO: Actually handle errors
         LogPrintf("Failed to accept RPC connection: %s: %s\n", error.message(), __func__);
     }
     // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
+    // do this before reading anything, to filter out
     // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address())) {
+    else if (!ClientAllowed(conn->peer.address())) {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
         if (!fUseSSL)
-            conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
-        conn->close();
+            conn->Reply(HTTPError(HTTP_FORBIDDEN, false), false);
+        else
+            conn->Reply("", false);
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        conn->Start();
     }
 }
 
@@ -577,6 +1016,47 @@ static ip::tcp::endpoint ParseEndpoint(const std::string& strEndpoint, int defau
     return ip::tcp::endpoint(asio::ip::address::from_string(addr), port);
 }
 
+static void RPCTimerThread()
+{
+    RenameThread("blocknetdx-rpctimer");
+    rpc_timer_service->run();
+}
+
+static void StartRPCTimerThread()
+{
+    if (rpc_timer_service != NULL)
+        return;
+    rpc_timer_service = new asio::io_service();
+    // Keep the thread from exiting while no timer is active
+    rpc_timer_work = new asio::io_service::work(*rpc_timer_service);
+    rpc_timer_thread = new boost::thread(&RPCTimerThread);
+}
+
+static void StopRPCTimerThread()
+{
+    if (rpc_timer_service == NULL)
+        return;
+    {
+        // Cancel the timers first, the destructor of asio::io_service can hang otherwise
+        LOCK(cs_deadlineTimers);
+        boost::system::error_code ec;
+        BOOST_FOREACH (const PAIRTYPE(std::string, boost::shared_ptr<deadline_timer>) & timer, deadlineTimers) {
+            timer.second->cancel(ec);
+            if (ec)
+                LogPrintf("%s: Warning: %s when cancelling timer", __func__, ec.message());
+        }
+        deadlineTimers.clear();
+    }
+    rpc_timer_service->stop();
+    rpc_timer_thread->join();
+    delete rpc_timer_thread;
+    rpc_timer_thread = NULL;
+    delete rpc_timer_work;
+    rpc_timer_work = NULL;
+    delete rpc_timer_service;
+    rpc_timer_service = NULL;
+}
+
 void StartRPCThreads()
 {
     rpc_allow_subnets.clear();
@@ -705,7 +1185,7 @@ void StartRPCThreads()
             acceptor->bind(endpoint);
             acceptor->listen(socket_base::max_connections);
 
-            RPCListen(acceptor, *rpc_ssl_context, fUseSSL);
+            RPCListen(acceptor, fUseSSL);
 
             rpc_acceptors.push_back(acceptor);
             fListening = true;
@@ -725,31 +1205,43 @@ void StartRPCThreads()
         return;
     }
 
+    // One thread drives all connections, the workers execute the requests
+    rpc_work_queue = new HTTPWorkQueue(std::max((int)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1));
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < std::max((int)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1); i++)
+        rpc_worker_group->create_thread(boost::bind(&HTTPWorkerThread, rpc_work_queue));
+
+    // Threads that help out with batch requests
+    int nBatchThreads = GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY) - 1;
+    if (nBatchThreads > 0) {
+        rpc_batch_service = new asio::io_service();
+        rpc_batch_work = new asio::io_service::work(*rpc_batch_service);
+        rpc_batch_group = new boost::thread_group();
+        for (int i = 0; i < nBatchThreads; i++)
+            rpc_batch_group->create_thread(boost::bind(&asio::io_service::run, rpc_batch_service));
+    }
+    StartRPCTimerThread();
     fRPCRunning = true;
 }
 
 void StartDummyRPCThread()
 {
-    if (rpc_io_service == NULL) {
-        rpc_io_service = new asio::io_service();
-        /* Create dummy "work" to keep the thread from exiting when no timeouts active,
-         * see http://www.boost.org/doc/libs/1_51_0/doc/html/boost_asio/reference/io_service.html#boost_asio.reference.io_service.stopping_the_io_service_from_running_out_of_work */
-        rpc_dummy_work = new asio::io_service::work(*rpc_io_service);
-        rpc_worker_group = new boost::thread_group();
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    if (rpc_timer_service == NULL) {
+        StartRPCTimerThread();
         fRPCRunning = true;
     }
 }
 
 void StopRPCThreads()
 {
-    if (rpc_io_service == NULL) return;
+    if (rpc_io_service == NULL && rpc_timer_service == NULL) return;
     // Set this to false first, so that longpolling loops will exit when woken up
     fRPCRunning = false;
 
+    StopRPCTimerThread();
+    if (rpc_io_service == NULL) return;
+
     // First, cancel all timers and acceptors
     // This is not done automatically by ->stop(), and in some cases the destructor of
     // asio::io_service can hang if this is skipped.
@@ -760,19 +1252,27 @@ void StopRPCThreads()
             LogPrintf("%s: Warning: %s when cancelling acceptor", __func__, ec.message());
     }
     rpc_acceptors.clear();
-    BOOST_FOREACH (const PAIRTYPE(std::string, boost::shared_ptr<deadline_timer>) & timer, deadlineTimers) {
-        timer.second->cancel(ec);
-        if (ec)
-            LogPrintf("%s: Warning: %s when cancelling timer", __func__, ec.message());
-    }
-    deadlineTimers.clear();
 
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     rpc_io_service->stop();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
-    delete rpc_dummy_work;
-    rpc_dummy_work = NULL;
+    // Queued requests hold connections, which need the io_service to close
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
+    if (rpc_batch_service != NULL) {
+        // Batches have all finished with the workers, whatever is left is a no-op
+        rpc_batch_service->stop();
+        rpc_batch_group->join_all();
+        delete rpc_batch_group;
+        rpc_batch_group = NULL;
+        delete rpc_batch_work;
+        rpc_batch_work = NULL;
+        delete rpc_batch_service;
+        rpc_batch_service = NULL;
+    }
     delete rpc_worker_group;
     rpc_worker_group = NULL;
     delete rpc_ssl_context;
@@ -815,11 +1315,12 @@ void RPCRunHandler(const boost::system::error_code& err, boost::function<void(vo
 
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds)
 {
-    assert(rpc_io_service != NULL);
+    assert(rpc_timer_service != NULL);
 
+    LOCK(cs_deadlineTimers);
     if (deadlineTimers.count(name) == 0) {
         deadlineTimers.insert(make_pair(name,
-            boost::shared_ptr<deadline_timer>(new deadline_timer(*rpc_io_service))));
+            boost::shared_ptr<deadline_timer>(new deadline_timer(*rpc_timer_service))));
     }
     deadlineTimers[name]->expires_from_now(posix_time::seconds(nSeconds));
     deadlineTimers[name]->async_wait(boost::bind(RPCRunHandler, _1, func));
@@ -887,11 +1388,123 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
+/**
+ * Commands of a batch that may run at the same time as each other. They must
+ * be thread safe and must not change any state, so that running them in a
+ * different order can't change a result.
+ */
+static const char* const pszBatchParallelCommands[] = {
+    "getinfo", "getnetworkinfo", "getaddednodeinfo", "getnettotals",
+    "getblockchaininfo", "getblockcount", "getblock", "getblockhash", "getmempoolinfo", "getrawmempool",
+    "gettxout", "gettxoutsetinfo", "getrawtransaction", "decoderawtransaction", "validateaddress",
+    "estimatefee", "estimatepriority",
+    "getaccount", "getaddressesbyaccount", "getbalance", "getreceivedbyaccount", "getreceivedbyaddress",
+    "gettransaction", "getwalletinfo", "listaccounts", "listaddressgroupings", "listsinceblock", "listunspent",
+    "dxGetOrderFills", "dxGetOrders", "dxGetOrder", "dxGetLocalTokens", "dxGetNetworkTokens",
+    "dxGetOrderHistory", "dxGetOrderBook", "dxGetTokenBalances", "dxGetMyOrders", "dxGetLockedUtxos",
+    "gettradingdata"};
+static const std::set<std::string> setBatchParallelCommands(pszBatchParallelCommands,
+    pszBatchParallelCommands + sizeof(pszBatchParallelCommands) / sizeof(pszBatchParallelCommands[0]));
+
+/**
+ * A run of consecutive batch requests that are executed by several threads.
+ * Threads claim requests one at a time, results keep the request order.
+ * Threads that only get to Run() after the last request was claimed return
+ * without touching vReq or vResults, which belong to the caller of Wait().
+ */
+class RPCBatchSegment
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    size_t nNext;
+    size_t nDone;
+    const Array& vReq;
+    std::vector<Object>& vResults;
+    const size_t nBegin;
+    const size_t nEnd;
+
+public:
+    RPCBatchSegment(const Array& vReqIn, std::vector<Object>& vResultsIn, size_t nBeginIn, size_t nEndIn) : nNext(nBeginIn), nDone(0), vReq(vReqIn), vResults(vResultsIn), nBegin(nBeginIn), nEnd(nEndIn) {}
+
+    /** Execute unclaimed requests until there are none left */
+    void Run()
+    {
+        while (true) {
+            size_t nIndex;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nNext >= nEnd)
+                    return;
+                nIndex = nNext++;
+            }
+            Object result;
+            try {
+                result = JSONRPCExecOne(vReq[nIndex]);
+            } catch (...) {
+                // A claimed request has to be marked done, or Wait() never returns
+                result = JSONRPCReplyObj(Value::null, JSONRPCError(RPC_MISC_ERROR, "unknown exception"), Value::null);
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vResults[nIndex] = result;
+                if (++nDone == nEnd - nBegin)
+                    cond.notify_all();
+            }
+        }
+    }
+
+    /** Wait for requests claimed by other threads */
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nDone < nEnd - nBegin)
+            cond.wait(lock);
+    }
+};
+
+static bool IsBatchParallelRequest(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& method = find_value(req.get_obj(), "method");
+    if (method.type() != str_type || !setBatchParallelCommands.count(method.get_str()))
+        return false;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->threadSafe;
+}
+
 static string JSONRPCExecBatch(const Array& vReq)
 {
+    std::vector<Object> vResults(vReq.size());
+    size_t nHelpersMax = std::max((int)GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY), 1) - 1;
+
+    // Requests run in order; only a run of read-only requests is spread over the helpers
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsBatchParallelRequest(vReq[nEnd]))
+            nEnd++;
+
+        if (nEnd - reqIdx < 2 || !rpc_batch_service || !nHelpersMax) {
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
+
+        // Helpers only speed things up; this thread claims whatever they don't get to
+        boost::shared_ptr<RPCBatchSegment> segment = boost::make_shared<RPCBatchSegment>(vReq, vResults, reqIdx, nEnd);
+        size_t nHelpers = std::min(nEnd - reqIdx - 1, nHelpersMax);
+        for (size_t i = 0; i < nHelpers; i++)
+            rpc_batch_service->post(boost::bind(&RPCBatchSegment::Run, segment));
+        segment->Run();
+        segment->Wait();
+        reqIdx = nEnd;
+    }
+
     Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+        ret.push_back(vResults[reqIdx]);
 
     return write_string(Value(ret), false) + "\n";
 }
@@ -938,6 +1551,21 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
         if (valRequest.type() == obj_type) {
             jreq.parse(valRequest);
 
+            // Large results are written straight into a chunked reply
+            const CRPCCommand* pcmd = tableRPC[jreq.strMethod];
+            std::ostream* pstream = (pcmd && pcmd->streamActor) ? conn->begin_chunked(HTTP_OK, fRun) : NULL;
+            if (pstream) {
+                CJSONStreamWriter writer(*pstream);
+                writer.BeginObject();
+                writer.Key("result");
+                tableRPC.executeStream(jreq.strMethod, jreq.params, writer);
+                writer.Write("error", Value::null);
+                writer.Write("id", jreq.id);
+                writer.EndObject();
+                *pstream << "\n";
+                return true;
+            }
+
             Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -951,52 +1579,58 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
 
         conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strReply.size()) << strReply << std::flush;
     } catch (Object& objError) {
+        if (!conn->cancel_chunked()) {
+            conn->close();
+            return false;
+        }
         ErrorReply(conn->stream(), objError, jreq.id);
         return false;
     } catch (std::exception& e) {
+        if (!conn->cancel_chunked()) {
+            conn->close();
+            return false;
+        }
         ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
+static void ProcessHTTPRequest(HTTPWorkItem& item)
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
+    HTTPReplyBuffer reply(item.conn, item.nProto);
+    bool fRun = item.fKeepAlive && !ShutdownRequested();
 
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
+    // Process via JSON-RPC API
+    if (item.strURI == "/") {
+        if (!HTTPReq_JSONRPC(&reply, item.strRequest, item.mapHeaders, fRun))
+            fRun = false;
 
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
+        // Process via HTTP REST API
+    } else if (item.strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
+        if (!HTTPReq_REST(&reply, item.strURI, item.mapHeaders, fRun))
             fRun = false;
 
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    } else {
+        reply.stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+        fRun = false;
+    }
 
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+    reply.Finish(fRun);
+}
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
-    }
+static Value CallRPCActor(const CRPCCommand* pcmd, const Array& params, CJSONStreamWriter* pwriter)
+{
+    if (!pwriter)
+        return pcmd->actor(params, false);
+    if (pcmd->streamActor)
+        pcmd->streamActor(params, *pwriter);
+    else
+        pwriter->Write(pcmd->actor(params, false));
+    return Value::null;
 }
 
-json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_spirit::Array& params) const
+static Value ExecuteRPC(const std::string& strMethod, const Array& params, CJSONStreamWriter* pwriter)
 {
     // Find method
     const CRPCCommand* pcmd = tableRPC[strMethod];
@@ -1018,34 +1652,26 @@ json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_s
         Value result;
         {
             if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
+                result = CallRPCActor(pcmd, params, pwriter);
 #ifdef ENABLE_WALLET
             else if (!pwalletMain) {
+                int64_t nWaitStart = GetTimeMicros();
                 LOCK(cs_main);
-                result = pcmd->actor(params, false);
+                RecordRPCLockWait(pcmd->name, GetTimeMicros() - nWaitStart);
+                result = CallRPCActor(pcmd, params, pwriter);
             } else {
-                while (true) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (!lockMain) {
-                        MilliSleep(50);
-                        continue;
-                    }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
-                            MilliSleep(50);
-                            continue;
-                        }
-                        result = pcmd->actor(params, false);
-                        break;
-                    }
-                    break;
-                }
+                // Block on both locks in the usual order instead of polling for them
+                int64_t nWaitStart = GetTimeMicros();
+                LOCK2(cs_main, pwalletMain->cs_wallet);
+                RecordRPCLockWait(pcmd->name, GetTimeMicros() - nWaitStart);
+                result = CallRPCActor(pcmd, params, pwriter);
             }
 #else  // ENABLE_WALLET
             else {
+                int64_t nWaitStart = GetTimeMicros();
                 LOCK(cs_main);
-                result = pcmd->actor(params, false);
+                RecordRPCLockWait(pcmd->name, GetTimeMicros() - nWaitStart);
+                result = CallRPCActor(pcmd, params, pwriter);
             }
 #endif // !ENABLE_WALLET
         }
@@ -1055,6 +1681,16 @@ json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_s
     }
 }
 
+json_spirit::Value CRPCTable::execute(const std::string& strMethod, const json_spirit::Array& params) const
+{
+    return ExecuteRPC(strMethod, params, NULL);
+}
+
+void CRPCTable::executeStream(const std::string& strMethod, const json_spirit::Array& params, CJSONStreamWriter& writer) const
+{
+    ExecuteRPC(strMethod, params, &writer);
+}
+
 std::string HelpExampleCli(string methodname, string args)
 {
     return "> blocknetdx-cli " + methodname + " " + args + "\n";
@@ -36,8 +36,26 @@ public:
     virtual void start() = 0;
     virtual void close() = 0;
     virtual bool is_closed() = 0;
+
+    /**
+     * Start a reply using chunked transfer encoding and return the stream
+     * for its body, or NULL if this connection or client can't do that.
+     */
+    virtual std::ostream* begin_chunked(int nStatus, bool keepalive, const char* contentType = "application/json") { return NULL; }
+    /**
+     * Throw away a chunked reply so a normal one can be sent instead.
+     * Returns false if part of it is already on the wire.
+     */
+    virtual bool cancel_chunked() { return true; }
 };
 
+/** Default for -rpcthreads, number of threads executing RPC requests */
+static const int DEFAULT_HTTP_THREADS = 4;
+/** Default for -rpcworkqueue, requests that may wait for a free RPC thread */
+static const int DEFAULT_HTTP_WORKQUEUE = 16;
+/** Default for -rpcbatchconcurrency, threads executing the read-only calls of one batch request */
+static const int DEFAULT_RPC_BATCH_CONCURRENCY = 4;
+
 /** Start RPC threads */
 void StartRPCThreads();
 /**
@@ -88,6 +106,8 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 extern CNetAddr BoostAsioToCNetAddr(boost::asio::ip::address address);
 
 typedef json_spirit::Value (*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
+/** Writes the same result as the command's actor straight to the reply */
+typedef void (*rpcstreamfn_type)(const json_spirit::Array& params, CJSONStreamWriter& writer);
 
 class CRPCCommand
 {
@@ -98,6 +118,7 @@ public:
     bool okSafeMode;
     bool threadSafe;
     bool reqWallet;
+    rpcstreamfn_type streamActor; //!< optional, used for single requests when the client can take a chunked reply
 };
 
 /**
@@ -121,6 +142,12 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string& method, const json_spirit::Array& params) const;
+
+    /**
+     * Execute a method and write its result to writer, using the method's
+     * streamActor if it has one.
+     */
+    void executeStream(const std::string& method, const json_spirit::Array& params, CJSONStreamWriter& writer) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -211,6 +238,7 @@ extern json_spirit::Value walletlock(const json_spirit::Array& params, bool fHel
 extern json_spirit::Value encryptwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validateaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getrpclockstats(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwalletinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnetworkinfo(const json_spirit::Array& params, bool fHelp);
@@ -222,6 +250,7 @@ extern json_spirit::Value getstakingstatus(const json_spirit::Array& params, boo
 
 extern json_spirit::Value getrawtransaction(const json_spirit::Array& params, bool fHelp); // in rcprawtransaction.cpp
 extern json_spirit::Value listunspent(const json_spirit::Array& params, bool fHelp);
+extern void listunspent_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value lockunspent(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listlockunspent(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value createrawtransaction(const json_spirit::Array& params, bool fHelp);
@@ -239,8 +268,11 @@ extern json_spirit::Value getmempoolinfo(const json_spirit::Array& params, bool
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
+extern void getblock_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 extern json_spirit::Value getblockheader(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxoutsetinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getcoinscacheinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getdbstats(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value verifychain(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getchaintips(const json_spirit::Array& params, bool fHelp);
@@ -527,6 +559,7 @@ extern json_spirit::Value dxCancelOrder(const json_spirit::Array& params, bool f
  * \endverbatim
  */
 extern json_spirit::Value dxGetOrderHistory(const json_spirit::Array& params, bool fHelp);
+extern void dxGetOrderHistory_stream(const json_spirit::Array& params, CJSONStreamWriter& writer);
 
 /**
  * @brief Returns transactions list in a form of 'order book'
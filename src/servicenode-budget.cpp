@@ -8,6 +8,7 @@
 #include "main.h"
 
 #include "addrman.h"
+#include "checkqueue.h"
 #include "servicenode-budget.h"
 #include "servicenode-sync.h"
 #include "servicenode.h"
@@ -26,6 +27,187 @@ std::map<uint256, int64_t> askedForSourceProposalOrBudget;
 std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
+/** Checks one vote signature; the result goes to *pfValid so a bad vote doesn't stop the batch */
+class CVoteSignatureCheck
+{
+private:
+    CPubKey pubKey;
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+    bool* pfValid;
+
+public:
+    CVoteSignatureCheck() : pfValid(NULL) {}
+    CVoteSignatureCheck(const CPubKey& pubKeyIn, const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn, bool* pfValidIn) : pubKey(pubKeyIn), vchSig(vchSigIn), strMessage(strMessageIn), pfValid(pfValidIn) {}
+
+    bool operator()()
+    {
+        std::string strError;
+        *pfValid = obfuScationSigner.VerifyMessage(pubKey, vchSig, strMessage, strError);
+        return true;
+    }
+
+    void swap(CVoteSignatureCheck& check)
+    {
+        std::swap(pubKey, check.pubKey);
+        vchSig.swap(check.vchSig);
+        strMessage.swap(check.strMessage);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+static CCheckQueue<CVoteSignatureCheck> budgetvotecheckqueue(32);
+
+/** A network vote waiting for its signature check, holding a reference on the peer that sent it */
+template <typename T>
+struct CPendingBudgetVote {
+    T vote;
+    CNode* pfrom;
+    CPubKey pubKey;
+    bool fSignatureValid;
+};
+
+/**
+ * Incoming budget votes are collected here instead of being verified one by one
+ * on the message handler thread. ThreadBudgetVoteVerify takes everything queued,
+ * checks the signatures across the vote check workers, then applies the votes.
+ */
+class CBudgetVoteQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<CPendingBudgetVote<CBudgetVote> > vProposalVotes;
+    std::vector<CPendingBudgetVote<CFinalizedBudgetVote> > vBudgetVotes;
+    bool fRunning;
+
+    template <typename T>
+    static void AddChecks(std::vector<CPendingBudgetVote<T> >& vVotes, std::vector<CVoteSignatureCheck>& vChecks)
+    {
+        for (unsigned int i = 0; i < vVotes.size(); i++) {
+            CPendingBudgetVote<T>& pending = vVotes[i];
+            pending.fSignatureValid = false;
+            vChecks.push_back(CVoteSignatureCheck(pending.pubKey, pending.vote.vchSig, pending.vote.GetSignatureMessage(), &pending.fSignatureValid));
+        }
+    }
+
+    /** Apply checked votes, returns the peers to punish for bad signatures */
+    template <typename T>
+    static void ProcessVotes(std::vector<CPendingBudgetVote<T> >& vVotes, std::vector<NodeId>& vMisbehaving)
+    {
+        for (unsigned int i = 0; i < vVotes.size(); i++) {
+            CPendingBudgetVote<T>& pending = vVotes[i];
+            if (!budget.ProcessVote(pending.pfrom, pending.vote, pending.fSignatureValid) && servicenodeSync.IsSynced())
+                vMisbehaving.push_back(pending.pfrom->GetId());
+        }
+    }
+
+    template <typename T>
+    static void ReleaseNodes(std::vector<CPendingBudgetVote<T> >& vVotes)
+    {
+        for (unsigned int i = 0; i < vVotes.size(); i++)
+            vVotes[i].pfrom->Release();
+        vVotes.clear();
+    }
+
+    template <typename T>
+    bool Add(std::vector<CPendingBudgetVote<T> >& vVotes, CNode* pfrom, const T& vote, const CPubKey& pubKey)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning)
+            return false;
+        // Falling back to inline checks slows down the peers flooding us, not the queue
+        if (vProposalVotes.size() + vBudgetVotes.size() >= MAX_BUDGET_VOTE_QUEUE) {
+            LogPrint("mnbudget", "CBudgetVoteQueue - queue full, checking vote of %s inline\n", vote.vin.prevout.ToStringShort());
+            return false;
+        }
+        CPendingBudgetVote<T> pending;
+        pending.vote = vote;
+        pending.pfrom = pfrom->AddRef();
+        pending.pubKey = pubKey;
+        pending.fSignatureValid = false;
+        vVotes.push_back(pending);
+        cond.notify_one();
+        return true;
+    }
+
+public:
+    CBudgetVoteQueue() : fRunning(false) {}
+
+    /** Queue a vote signed by pubKey; false if nothing is consuming the queue or it is full, and the caller should check it itself */
+    bool Push(CNode* pfrom, const CBudgetVote& vote, const CPubKey& pubKey) { return Add(vProposalVotes, pfrom, vote, pubKey); }
+    bool Push(CNode* pfrom, const CFinalizedBudgetVote& vote, const CPubKey& pubKey) { return Add(vBudgetVotes, pfrom, vote, pubKey); }
+
+    void Run()
+    {
+        std::vector<CPendingBudgetVote<CBudgetVote> > vProposalBatch;
+        std::vector<CPendingBudgetVote<CFinalizedBudgetVote> > vBudgetBatch;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fRunning = true;
+        }
+
+        try {
+            while (true) {
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (vProposalVotes.empty() && vBudgetVotes.empty())
+                        cond.wait(lock);
+                    vProposalBatch.swap(vProposalVotes);
+                    vBudgetBatch.swap(vBudgetVotes);
+                }
+
+                std::vector<CVoteSignatureCheck> vChecks;
+                vChecks.reserve(vProposalBatch.size() + vBudgetBatch.size());
+                AddChecks(vProposalBatch, vChecks);
+                AddChecks(vBudgetBatch, vChecks);
+                {
+                    CCheckQueueControl<CVoteSignatureCheck> control(&budgetvotecheckqueue);
+                    control.Add(vChecks);
+                    control.Wait();
+                }
+
+                std::vector<NodeId> vMisbehaving;
+                {
+                    LOCK(cs_budget);
+                    ProcessVotes(vProposalBatch, vMisbehaving);
+                    ProcessVotes(vBudgetBatch, vMisbehaving);
+                }
+                if (!vMisbehaving.empty()) {
+                    LOCK(cs_main);
+                    BOOST_FOREACH (NodeId id, vMisbehaving)
+                        Misbehaving(id, 20);
+                }
+
+                ReleaseNodes(vProposalBatch);
+                ReleaseNodes(vBudgetBatch);
+            }
+        } catch (boost::thread_interrupted) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fRunning = false;
+            ReleaseNodes(vProposalBatch);
+            ReleaseNodes(vBudgetBatch);
+            ReleaseNodes(vProposalVotes);
+            ReleaseNodes(vBudgetVotes);
+            throw;
+        }
+    }
+};
+
+static CBudgetVoteQueue budgetVoteQueue;
+
+void ThreadBudgetVoteVerify()
+{
+    RenameThread("blocknetdx-budgetvote");
+    budgetVoteQueue.Run();
+}
+
+void ThreadBudgetVoteCheck()
+{
+    RenameThread("blocknetdx-budgetvch");
+    budgetvotecheckqueue.Thread();
+}
+
 int GetBudgetPaymentCycleBlocks()
 {
     // Amount of blocks in a months period of time (using 1 minutes per) = (60*24*30)
@@ -1101,21 +1283,13 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
 
         mapSeenServicenodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
-        if (!vote.SignatureValid(true)) {
-            LogPrintf("mvote - signature invalid\n");
-            if (servicenodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
-            // it could just be a non-synced servicenode
-            mnodeman.AskForMN(pfrom, vote.vin);
-            return;
-        }
 
-        std::string strError = "";
-        if (UpdateProposal(vote, pfrom, strError)) {
-            vote.Relay();
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
-        }
+        // Signature checked in the next batch, see ThreadBudgetVoteVerify
+        if (budgetVoteQueue.Push(pfrom, vote, pmn->pubKeyServicenode))
+            return;
 
-        LogPrint("mnbudget", "mvote - new budget vote - %s\n", vote.GetHash().ToString());
+        if (!ProcessVote(pfrom, vote, vote.SignatureValid(true)) && servicenodeSync.IsSynced())
+            Misbehaving(pfrom->GetId(), 20);
     }
 
     if (strCommand == "fbs") { //Finalized Budget Suggestion
@@ -1173,24 +1347,54 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         }
 
         mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
-        if (!vote.SignatureValid(true)) {
-            LogPrintf("fbvote - signature invalid\n");
-            if (servicenodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
-            // it could just be a non-synced servicenode
-            mnodeman.AskForMN(pfrom, vote.vin);
+
+        // Signature checked in the next batch, see ThreadBudgetVoteVerify
+        if (budgetVoteQueue.Push(pfrom, vote, pmn->pubKeyServicenode))
             return;
-        }
 
-        std::string strError = "";
-        if (UpdateFinalizedBudget(vote, pfrom, strError)) {
-            vote.Relay();
-            servicenodeSync.AddedBudgetItem(vote.GetHash());
+        if (!ProcessVote(pfrom, vote, vote.SignatureValid(true)) && servicenodeSync.IsSynced())
+            Misbehaving(pfrom->GetId(), 20);
+    }
+}
 
-            LogPrintf("fbvote - new finalized budget vote - %s\n", vote.GetHash().ToString());
-        } else {
-            LogPrintf("fbvote - rejected finalized budget vote - %s - %s\n", vote.GetHash().ToString(), strError);
-        }
+bool CBudgetManager::ProcessVote(CNode* pfrom, CBudgetVote& vote, bool fSignatureValid)
+{
+    if (!fSignatureValid) {
+        LogPrintf("mvote - signature invalid\n");
+        // it could just be a non-synced servicenode
+        mnodeman.AskForMN(pfrom, vote.vin);
+        return false;
+    }
+
+    std::string strError = "";
+    if (UpdateProposal(vote, pfrom, strError)) {
+        vote.Relay();
+        servicenodeSync.AddedBudgetItem(vote.GetHash());
     }
+
+    LogPrint("mnbudget", "mvote - new budget vote - %s\n", vote.GetHash().ToString());
+    return true;
+}
+
+bool CBudgetManager::ProcessVote(CNode* pfrom, CFinalizedBudgetVote& vote, bool fSignatureValid)
+{
+    if (!fSignatureValid) {
+        LogPrintf("fbvote - signature invalid\n");
+        // it could just be a non-synced servicenode
+        mnodeman.AskForMN(pfrom, vote.vin);
+        return false;
+    }
+
+    std::string strError = "";
+    if (UpdateFinalizedBudget(vote, pfrom, strError)) {
+        vote.Relay();
+        servicenodeSync.AddedBudgetItem(vote.GetHash());
+
+        LogPrintf("fbvote - new finalized budget vote - %s\n", vote.GetHash().ToString());
+    } else {
+        LogPrintf("fbvote - rejected finalized budget vote - %s - %s\n", vote.GetHash().ToString(), strError);
+    }
+    return true;
 }
 
 bool CBudgetManager::PropExists(uint256 nHash)
@@ -1404,6 +1608,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1416,6 +1621,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1430,6 +1636,7 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
     fValid = true;
+    RecountVotes();
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
@@ -1511,7 +1718,11 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if (it != mapVotes.end())
+        TallyVote((*it).second, -1);
     mapVotes[hash] = vote;
+    TallyVote(vote, 1);
     return true;
 }
 
@@ -1521,66 +1732,56 @@ void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fValidVote = (*it).second.SignatureValid(fSignatureCheck);
+        if (fValidVote != (*it).second.fValid) {
+            TallyVote((*it).second, -1);
+            (*it).second.fValid = fValidVote;
+            TallyVote((*it).second, 1);
+        }
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+void CBudgetProposal::TallyVote(const CBudgetVote& vote, int nDelta)
 {
-    int yeas = 0;
-    int nays = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
-        ++it;
-    }
-
-    if (yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas + nays));
+    if (vote.nVote < VOTE_ABSTAIN || vote.nVote > VOTE_NO)
+        return;
+    nAllVotes[vote.nVote] += nDelta;
+    if (vote.fValid)
+        nValidVotes[vote.nVote] += nDelta;
 }
 
-int CBudgetProposal::GetYeas()
+void CBudgetProposal::RecountVotes()
 {
-    int ret = 0;
+    for (int i = VOTE_ABSTAIN; i <= VOTE_NO; i++) {
+        nValidVotes[i] = 0;
+        nAllVotes[i] = 0;
+    }
 
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
+        TallyVote((*it).second, 1);
         ++it;
     }
-
-    return ret;
 }
 
-int CBudgetProposal::GetNays()
+void CBudgetProposal::SwapVotes(CBudgetProposal& other)
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
+    using std::swap;
 
-    return ret;
+    mapVotes.swap(other.mapVotes);
+    swap(nValidVotes, other.nValidVotes);
+    swap(nAllVotes, other.nAllVotes);
 }
 
-int CBudgetProposal::GetAbstains()
+double CBudgetProposal::GetRatio()
 {
-    int ret = 0;
+    int yeas = nAllVotes[VOTE_YES];
+    int nays = nAllVotes[VOTE_NO];
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
+    if (yeas + nays == 0) return 0.0f;
 
-    return ret;
+    return ((double)(yeas) / (double)(yeas + nays));
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1677,6 +1878,11 @@ CBudgetVote::CBudgetVote(CTxIn vinIn, uint256 nProposalHashIn, int nVoteIn)
     fSynced = false;
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 void CBudgetVote::Relay()
 {
     LogPrintf("CBudgetVote::Relay - Sending vote %s %s", nProposalHash.GetHex(), this->GetVoteString());
@@ -1691,7 +1897,7 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1709,7 +1915,7 @@ bool CBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CServicenode* pmn = mnodeman.Find(vin);
 
@@ -2120,6 +2326,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode)
 {
     // Choose coins to use
@@ -2127,7 +2338,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyServicenode)) {
         LogPrintf("CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2146,7 +2357,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CServicenode* pmn = mnodeman.Find(vin);
 
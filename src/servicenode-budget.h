@@ -33,6 +33,8 @@ class CTxBudgetPayment;
 
 static const int64_t BUDGET_FEE_CONFIRMATIONS = 6;
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
+/** Votes waiting for a batched signature check before new ones are checked on the message handler thread */
+static const unsigned int MAX_BUDGET_VOTE_QUEUE = 5000;
 
 extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
@@ -43,6 +45,10 @@ void DumpBudgets();
 // Define amount of blocks in budget payment cycle
 int GetBudgetPaymentCycleBlocks();
 
+// Threads verifying the signatures of incoming budget votes in batches
+void ThreadBudgetVoteVerify();
+void ThreadBudgetVoteCheck();
+
 //Check the collateral transaction for the budget proposal/finalized budget
 bool IsBudgetCollateralValid(uint256 nTxCollateralHash, uint256 nExpectedHash, std::string& strError, int64_t& nTime, int& nConf);
 
@@ -72,6 +78,7 @@ public:
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     std::string GetVoteString()
     {
@@ -124,6 +131,7 @@ public:
     bool Sign(CKey& keyServicenode, CPubKey& pubKeyServicenode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     uint256 GetHash()
     {
@@ -235,6 +243,9 @@ public:
 
     bool UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string& strError);
     bool UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError);
+    /** Apply a network vote whose signature has been checked; false if the signature was bad (caller needs cs_budget) */
+    bool ProcessVote(CNode* pfrom, CBudgetVote& vote, bool fSignatureValid);
+    bool ProcessVote(CNode* pfrom, CFinalizedBudgetVote& vote, bool fSignatureValid);
     bool PropExists(uint256 nHash);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     std::string GetRequiredPaymentsString(int nBlockHeight);
@@ -444,6 +455,13 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // Running vote counts per VOTE_* value, kept in step with mapVotes
+    int nValidVotes[VOTE_NO + 1]; //valid votes only
+    int nAllVotes[VOTE_NO + 1];   //every vote, for GetRatio()
+
+    void TallyVote(const CBudgetVote& vote, int nDelta);
+    void RecountVotes();
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -490,9 +508,9 @@ public:
     int GetBlockCurrentCycle();
     int GetBlockEndCycle();
     double GetRatio();
-    int GetYeas();
-    int GetNays();
-    int GetAbstains();
+    int GetYeas() { return nValidVotes[VOTE_YES]; }
+    int GetNays() { return nValidVotes[VOTE_NO]; }
+    int GetAbstains() { return nValidVotes[VOTE_ABSTAIN]; }
     CAmount GetAmount() { return nAmount; }
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
@@ -504,6 +522,8 @@ public:
     }
 
     void CleanAndRemove(bool fSignatureCheck);
+    // Exchange votes and their counts with other
+    void SwapVotes(CBudgetProposal& other);
 
     uint256 GetHash()
     {
@@ -537,6 +557,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -564,7 +586,7 @@ public:
         swap(first.address, second.address);
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
-        first.mapVotes.swap(second.mapVotes);
+        first.SwapVotes(second);
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -289,6 +289,67 @@ public:
 };
 
 
+/** Read-only stream over a caller-owned memory range.
+ *
+ * Deserializes in place without copying the data into a buffer first.
+ * The memory must stay valid for the lifetime of the reader.
+ */
+class CMemoryReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+    const char* pcur;
+
+    int nType;
+    int nVersion;
+
+public:
+    CMemoryReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn)
+        : pbegin(pbeginIn), pend(pendIn), pcur(pbeginIn), nType(nTypeIn), nVersion(nVersionIn)
+    {
+    }
+
+    //
+    // Stream subset
+    //
+    bool eof() const { return pcur == pend; }
+    size_t size() const { return pend - pcur; }
+    size_t GetPos() const { return pcur - pbegin; }
+
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read() : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(int nSize)
+    {
+        assert(nSize >= 0);
+        if ((size_t)nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore() : end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
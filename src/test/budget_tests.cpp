@@ -0,0 +1,109 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "servicenode-budget.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(budget_tests)
+
+// Count the votes of proposal from scratch and compare with its running tallies
+static void CheckTallies(CBudgetProposal& proposal)
+{
+    int nYeas = 0, nNays = 0, nAbstains = 0, nAllYeas = 0, nAllNays = 0;
+    std::map<uint256, CBudgetVote>::iterator it = proposal.mapVotes.begin();
+    while (it != proposal.mapVotes.end()) {
+        const CBudgetVote& vote = (*it).second;
+        if (vote.nVote == VOTE_YES) nAllYeas++;
+        if (vote.nVote == VOTE_NO) nAllNays++;
+        if (vote.fValid) {
+            if (vote.nVote == VOTE_YES) nYeas++;
+            if (vote.nVote == VOTE_NO) nNays++;
+            if (vote.nVote == VOTE_ABSTAIN) nAbstains++;
+        }
+        ++it;
+    }
+
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), nYeas);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), nNays);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), nAbstains);
+    double dRatio = nAllYeas + nAllNays == 0 ? 0.0 : (double)nAllYeas / (double)(nAllYeas + nAllNays);
+    BOOST_CHECK_EQUAL(proposal.GetRatio(), dRatio);
+}
+
+static CTxIn ServicenodeVin(unsigned int n)
+{
+    return CTxIn(COutPoint(uint256(n + 1), n));
+}
+
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    int64_t nTime = 1500000000;
+    SetMockTime(nTime);
+
+    CBudgetProposal proposal("test", "http://test", 0, 100, CScript() << OP_TRUE, 10 * COIN, uint256(42));
+    uint256 hashProposal = proposal.GetHash();
+    std::string strError;
+
+    // Add votes of every kind
+    for (unsigned int i = 0; i < 12; i++) {
+        CBudgetVote vote(ServicenodeVin(i), hashProposal, i % 3);
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 4);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 4);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 4);
+    CheckTallies(proposal);
+
+    // An update too soon is rejected and leaves the tallies alone
+    CBudgetVote voteEarly(ServicenodeVin(0), hashProposal, VOTE_YES);
+    BOOST_CHECK(!proposal.AddOrUpdateVote(voteEarly, strError));
+    CheckTallies(proposal);
+
+    // Updated votes move between the tallies instead of adding to them
+    SetMockTime(nTime + BUDGET_VOTE_UPDATE_MIN + 1);
+    for (unsigned int i = 0; i < 6; i++) {
+        CBudgetVote vote(ServicenodeVin(i), hashProposal, VOTE_NO);
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    BOOST_CHECK_EQUAL(proposal.mapVotes.size(), 12U);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 8);
+    CheckTallies(proposal);
+
+    // Votes of unknown servicenodes are no longer counted after cleaning,
+    // except by GetRatio which counts every vote
+    proposal.CleanAndRemove(false);
+    BOOST_CHECK_EQUAL(proposal.GetYeas() + proposal.GetNays() + proposal.GetAbstains(), 0);
+    CheckTallies(proposal);
+
+    // A vote updated after it was invalidated counts again
+    SetMockTime(nTime + 2 * BUDGET_VOTE_UPDATE_MIN + 2);
+    CBudgetVote voteAgain(ServicenodeVin(3), hashProposal, VOTE_YES);
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteAgain, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 1);
+    CheckTallies(proposal);
+
+    // Copies, broadcasts and deserialized proposals carry the same tallies
+    CBudgetProposal proposalCopy(proposal);
+    CheckTallies(proposalCopy);
+    BOOST_CHECK_EQUAL(proposalCopy.GetYeas(), proposal.GetYeas());
+
+    CBudgetProposalBroadcast broadcast;
+    broadcast = CBudgetProposalBroadcast(proposal);
+    CheckTallies(broadcast);
+    BOOST_CHECK_EQUAL(broadcast.GetYeas(), proposal.GetYeas());
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << proposal;
+    CBudgetProposal proposalRead;
+    ss >> proposalRead;
+    CheckTallies(proposalRead);
+    BOOST_CHECK_EQUAL(proposalRead.GetYeas(), proposal.GetYeas());
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -58,6 +58,23 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    void SelfTest() const
+    {
+        // Recompute the memory accounting of the whole cache and compare
+        size_t ret = 0;
+        for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++)
+            ret += it->second.coins.DynamicMemoryUsage();
+        BOOST_CHECK_EQUAL(cachedCoinsUsage, ret);
+        BOOST_CHECK_EQUAL(poolCoins.ObjectsInUse(), cacheCoins.size());
+        BOOST_CHECK(cacheCoins.empty() == (poolCoins.BytesAllocated() == 0));
+    }
+};
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -89,8 +106,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
-    std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
-    stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
+    std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
+    stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -115,6 +132,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 coins.nVersion = insecure_rand();
                 coins.vout.resize(1);
                 coins.vout[0].nValue = insecure_rand();
+                coins.vout[0].scriptPubKey.assign(insecure_rand() & 0x3F, 0);
                 *entry = coins;
             } else {
                 coins.Clear();
@@ -135,6 +153,9 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                     missed_an_entry = true;
                 }
             }
+            BOOST_FOREACH (const CCoinsViewCacheTest* test, stack) {
+                test->SelfTest();
+            }
         }
 
         if (insecure_rand() % 100 == 0) {
@@ -151,7 +172,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCache(tip));
+                stack.push_back(new CCoinsViewCacheTest(tip));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -175,4 +196,56 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Coins added through GetCoinsFromBase/AddFetchedCoins must behave exactly
+// like entries the cache fetched on demand.
+BOOST_AUTO_TEST_CASE(coins_prefetch_test)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> txids;
+    {
+        CCoinsViewCache init(&base);
+        for (unsigned int i = 0; i < 20; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier coins = init.ModifyCoins(txids.back());
+            coins->vout.resize(1);
+            coins->vout[0].nValue = i + 1;
+        }
+        init.Flush();
+    }
+    txids.push_back(GetRandHash()); // not in the base view
+
+    CCoinsViewCache prefetched(&base);
+    CCoinsViewCache ondemand(&base);
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        BOOST_CHECK(!prefetched.HaveCoinsInCache(txids[i]));
+        CCoins coins;
+        bool fFound = prefetched.GetCoinsFromBase(txids[i], coins);
+        BOOST_CHECK_EQUAL(fFound, i < 20);
+        if (fFound)
+            prefetched.AddFetchedCoins(txids[i], coins);
+        BOOST_CHECK_EQUAL(prefetched.HaveCoinsInCache(txids[i]), fFound);
+    }
+    BOOST_CHECK_EQUAL(prefetched.GetCacheSize(), 20U);
+
+    // An entry already in the cache is not replaced
+    CCoins stale;
+    stale.vout.resize(1);
+    stale.vout[0].nValue = 1000;
+    prefetched.AddFetchedCoins(txids[0], stale);
+
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        const CCoins* pcoins1 = prefetched.AccessCoins(txids[i]);
+        const CCoins* pcoins2 = ondemand.AccessCoins(txids[i]);
+        BOOST_CHECK_EQUAL(pcoins1 == NULL, pcoins2 == NULL);
+        if (pcoins1 && pcoins2)
+            BOOST_CHECK(*pcoins1 == *pcoins2);
+    }
+
+    // Spending a prefetched output reaches the base view on flush
+    prefetched.ModifyCoins(txids[1])->Spend(0);
+    prefetched.Flush();
+    CCoins coins;
+    BOOST_CHECK(!base.GetCoins(txids[1], coins) || coins.IsPruned());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,7 +9,9 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "random.h"
+#include "uint256.h"
 #include "utilstrencodings.h"
 
 #include <vector>
@@ -282,4 +284,46 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+static MuHash3072 MuHashFromInt(unsigned char i)
+{
+    unsigned char data[32] = {i};
+    MuHash3072 muhash;
+    muhash.Insert(data, sizeof(data));
+    return muhash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+    MuHash3072 acc = MuHashFromInt(0);
+    acc *= MuHashFromInt(1);
+    acc /= MuHashFromInt(2);
+    acc.Finalize(out.begin());
+    BOOST_CHECK_EQUAL(out.GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // Order of insertions and removals does not matter, and they cancel out
+    for (int i = 0; i < 10; i++) {
+        unsigned char x = insecure_rand(), y = insecure_rand(), z = insecure_rand();
+        MuHash3072 a, b;
+        a.Insert(&x, 1);
+        a.Insert(&y, 1);
+        a.Remove(&z, 1);
+        b.Remove(&z, 1);
+        b.Insert(&y, 1);
+        b.Insert(&x, 1);
+        BOOST_CHECK(a == b);
+
+        uint256 outA, outB;
+        a.Finalize(outA.begin());
+        b.Finalize(outB.begin());
+        BOOST_CHECK(outA == outB);
+
+        a.Insert(&z, 1);
+        a.Remove(&x, 1);
+        a.Remove(&y, 1);
+        BOOST_CHECK(a == MuHash3072());
+    }
+    BOOST_CHECK(MuHashFromInt(0) != MuHashFromInt(1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#define SELECTION_INTERVAL 600
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+// Build count blocks on top of pindexPrev with jittery, sometimes decreasing,
+// timestamps and a stake modifier generated on most of them
+static void BuildBranch(std::vector<CBlockIndex>& vBlocks, std::vector<uint256>& vHashes, CBlockIndex* pindexPrev, uint64_t nSalt)
+{
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        CBlockIndex& block = vBlocks[i];
+        CBlockIndex* pprev = i ? &vBlocks[i - 1] : pindexPrev;
+        vHashes[i] = (uint256(nSalt) << 64) + i;
+        block.phashBlock = &vHashes[i];
+        block.pprev = pprev;
+        block.nHeight = pprev ? pprev->nHeight + 1 : 0;
+        block.nTime = pprev ? pprev->nTime + insecure_rand() % 120 - 30 : 1500000000;
+        block.SetStakeModifier(((uint64_t)insecure_rand() << 32) | insecure_rand(), insecure_rand() % 4 != 0);
+        block.BuildSkip();
+    }
+}
+
+// Every block of chain must get the modifier the forward walk finds
+static void CheckTable(const CStakeModifierTable& table, const CChain& chain)
+{
+    for (int nHeight = 0; nHeight <= chain.Height(); nHeight++) {
+        uint64_t nModifierWalk = 0, nModifierTable = 0;
+        int nHeightWalk = 0, nHeightTable = 0;
+        int64_t nTimeWalk = 0, nTimeTable = 0;
+        bool fWalk = GetKernelStakeModifierWalk(chain, chain[nHeight], SELECTION_INTERVAL, nModifierWalk, nHeightWalk, nTimeWalk);
+        bool fTable = table.Get(chain, chain[nHeight], nModifierTable, nHeightTable, nTimeTable);
+        BOOST_CHECK_EQUAL(fWalk, fTable);
+        if (fWalk && fTable) {
+            BOOST_CHECK_EQUAL(nModifierWalk, nModifierTable);
+            BOOST_CHECK_EQUAL(nHeightWalk, nHeightTable);
+            BOOST_CHECK_EQUAL(nTimeWalk, nTimeTable);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_table)
+{
+    std::vector<CBlockIndex> vBlocksMain(2000);
+    std::vector<uint256> vHashMain(vBlocksMain.size());
+    BuildBranch(vBlocksMain, vHashMain, NULL, 1);
+
+    // Side branch splitting off at block 1499
+    std::vector<CBlockIndex> vBlocksSide(700);
+    std::vector<uint256> vHashSide(vBlocksSide.size());
+    BuildBranch(vBlocksSide, vHashSide, &vBlocksMain[1499], 2);
+
+    CChain chain;
+    CStakeModifierTable table(SELECTION_INTERVAL);
+
+    // Connect the main chain in steps
+    for (int nHeight = 999; nHeight < 2000; nHeight += 500) {
+        chain.SetTip(&vBlocksMain[nHeight]);
+        table.SetTip(chain.Tip());
+        CheckTable(table, chain);
+    }
+
+    // A table for another tip is not used
+    uint64_t nModifier = 0;
+    int nHeight = 0;
+    int64_t nTime = 0;
+    chain.SetTip(&vBlocksSide.back());
+    BOOST_CHECK(!table.Get(chain, chain[0], nModifier, nHeight, nTime));
+
+    // Reorganize to the side branch and back
+    table.SetTip(chain.Tip());
+    CheckTable(table, chain);
+
+    chain.SetTip(&vBlocksMain.back());
+    table.SetTip(chain.Tip());
+    CheckTable(table, chain);
+
+    // Disconnect a few blocks
+    chain.SetTip(&vBlocksMain[1789]);
+    table.SetTip(chain.Tip());
+    CheckTable(table, chain);
+
+    table.SetTip(NULL);
+    BOOST_CHECK(table.Tip() == NULL);
+    BOOST_CHECK(!table.Get(chain, chain[0], nModifier, nHeight, nTime));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
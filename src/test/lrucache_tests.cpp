@@ -0,0 +1,57 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+#define MAX_SIZE 100
+
+BOOST_AUTO_TEST_SUITE(lrucache_tests)
+
+// Test that an lrucache's size never exceeds its max_size
+BOOST_AUTO_TEST_CASE(lrucache_limited_size)
+{
+    lrucache<int, int> cache(MAX_SIZE);
+    for (int nAction = 0; nAction < 3 * MAX_SIZE; nAction++) {
+        int n = GetRandInt(2 * MAX_SIZE);
+        cache.insert(n, n * 2);
+        BOOST_CHECK(cache.size() <= MAX_SIZE);
+    }
+}
+
+// Test that the least recently used element is the one evicted
+BOOST_AUTO_TEST_CASE(lrucache_evicts_least_recent)
+{
+    lrucache<int, int> cache(3);
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    cache.insert(3, 30);
+
+    int v = 0;
+    BOOST_CHECK(cache.get(1, v) && v == 10); // 1 becomes most recent
+    cache.insert(4, 40);                     // evicts 2
+
+    BOOST_CHECK(cache.count(1) == 1);
+    BOOST_CHECK(cache.count(2) == 0);
+    BOOST_CHECK(cache.count(3) == 1);
+    BOOST_CHECK(cache.count(4) == 1);
+
+    cache.insert(3, 33); // replace refreshes 3
+    cache.insert(5, 50); // evicts 1
+    BOOST_CHECK(cache.count(1) == 0);
+    BOOST_CHECK(cache.get(3, v) && v == 33);
+
+    cache.erase(3);
+    BOOST_CHECK(!cache.get(3, v));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+    cache.max_size(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.count(5) == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
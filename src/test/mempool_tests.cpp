@@ -99,4 +99,164 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolPackageTest)
+{
+    // Parent with two outputs, a child spending one and a grandchild spending the child
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild.GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 1000, 1, 0.0, 1));
+    testPool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 100000, 2, 0.0, 1));
+
+    const CTxMemPoolEntry& parent = testPool.mapTx[txParent.GetHash()];
+    const CTxMemPoolEntry& grandChild = testPool.mapTx[txGrandChild.GetHash()];
+    BOOST_CHECK_EQUAL(parent.GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(parent.GetModFeesWithDescendants(), 101000);
+    BOOST_CHECK_EQUAL(grandChild.GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(grandChild.GetModFeesWithAncestors(), 101000);
+
+    // The grandchild pays for its ancestors, so its package is ranked first
+    BOOST_CHECK(testPool.setByAncestorScore.rbegin()->hash == txGrandChild.GetHash());
+
+    std::set<uint256> setAncestors;
+    testPool.CalculateAncestors(txGrandChild, setAncestors);
+    BOOST_CHECK_EQUAL(setAncestors.size(), 2U);
+
+    // Removing the grandchild updates its ancestors' package state
+    testPool.remove(txGrandChild, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 1U);
+    removed.clear();
+    BOOST_CHECK_EQUAL(testPool.mapTx[txParent.GetHash()].GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(testPool.mapTx[txParent.GetHash()].GetModFeesWithDescendants(), 1000);
+
+    // Prioritising the parent moves its own package and that of its child
+    testPool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 500);
+    BOOST_CHECK_EQUAL(testPool.mapTx[txParent.GetHash()].GetModFeesWithDescendants(), 1500);
+    BOOST_CHECK_EQUAL(testPool.mapTx[txChild.GetHash()].GetModFeesWithAncestors(), 1500);
+    testPool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, -500);
+    BOOST_CHECK_EQUAL(testPool.mapTx[txChild.GetHash()].GetModFeesWithAncestors(), 1000);
+    BOOST_CHECK_EQUAL(testPool.setByPriority.size(), testPool.size());
+
+    // Expire drops old transactions together with their descendants
+    BOOST_CHECK_EQUAL(testPool.Expire(1, removed), 2);
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
+    removed.clear();
+
+    // Trimming evicts the lowest descendant score first
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 1000, 1, 0.0, 1));
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_12;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    txOther.vout[0].nValue = 10000LL;
+    testPool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 50000, 2, 0.0, 1));
+    testPool.TrimToSize(testPool.GetTotalTxSize() - 1, removed);
+    BOOST_CHECK(testPool.exists(txOther.GetHash()));
+    BOOST_CHECK(!testPool.exists(txParent.GetHash()));
+    BOOST_CHECK(!testPool.exists(txChild.GetHash()));
+    removed.clear();
+
+    // Removing a mined parent leaves the child as a package of its own
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 1000, 1, 0.0, 1));
+    testPool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1U);
+    const CTxMemPoolEntry& child = testPool.mapTx[txChild.GetHash()];
+    BOOST_CHECK_EQUAL(child.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(child.GetSizeWithAncestors(), child.GetTxSize());
+    BOOST_CHECK_EQUAL(child.GetModFeesWithAncestors(), 1000);
+    BOOST_CHECK_EQUAL(testPool.setByPriority.size(), testPool.size());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReorgPackageTest)
+{
+    // A block with a parent and its child is disconnected while a grandchild
+    // spending both is still in the pool
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(2);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild.GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vin[1].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[1].prevout.hash = txParent.GetHash();
+    txGrandChild.vin[1].prevout.n = 1;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+
+    // The block's transactions come back in block order
+    testPool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 100, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 10, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 1, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& parent = testPool.mapTx[txParent.GetHash()];
+    const CTxMemPoolEntry& child = testPool.mapTx[txChild.GetHash()];
+    const CTxMemPoolEntry& grandChild = testPool.mapTx[txGrandChild.GetHash()];
+    BOOST_CHECK_EQUAL(parent.GetCountWithDescendants(), 3U);
+    BOOST_CHECK_EQUAL(parent.GetModFeesWithDescendants(), 111);
+    BOOST_CHECK_EQUAL(parent.GetSizeWithDescendants(), parent.GetTxSize() + child.GetTxSize() + grandChild.GetTxSize());
+    BOOST_CHECK_EQUAL(child.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(child.GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(child.GetModFeesWithDescendants(), 101);
+    BOOST_CHECK_EQUAL(grandChild.GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(grandChild.GetModFeesWithAncestors(), 111);
+    BOOST_CHECK_EQUAL(grandChild.GetSizeWithAncestors(), parent.GetTxSize() + child.GetTxSize() + grandChild.GetTxSize());
+
+    // Mining the block again leaves the grandchild on its own
+    testPool.remove(txParent, removed, false);
+    testPool.remove(txChild, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 2U);
+    const CTxMemPoolEntry& grandChildAfter = testPool.mapTx[txGrandChild.GetHash()];
+    BOOST_CHECK_EQUAL(grandChildAfter.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(grandChildAfter.GetSizeWithAncestors(), grandChildAfter.GetTxSize());
+    BOOST_CHECK_EQUAL(grandChildAfter.GetModFeesWithAncestors(), 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
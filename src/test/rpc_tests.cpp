@@ -180,4 +180,49 @@ BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
     BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
 }
 
+// The streaming writer must produce exactly what write_string() does for the same tree
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    Object inner;
+    inner.push_back(Pair("txid", "ab\"cd"));
+    inner.push_back(Pair("amount", 1.5));
+    inner.push_back(Pair("spendable", true));
+    Array list;
+    list.push_back(inner);
+    list.push_back(Array());
+    list.push_back(Value::null);
+    list.push_back(42);
+    Object head;
+    head.push_back(Pair("hash", "00ff"));
+    head.push_back(Pair("empty", Object()));
+    Object tail;
+    tail.push_back(Pair("time", (int64_t)1234567890));
+
+    Object expected = head;
+    expected.push_back(Pair("tx", list));
+    expected.insert(expected.end(), tail.begin(), tail.end());
+
+    std::ostringstream ss;
+    CJSONStreamWriter writer(ss);
+    writer.BeginObject();
+    writer.WriteMembers(head);
+    writer.Key("tx");
+    writer.BeginArray();
+    writer.Write(inner);
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Write(Value::null);
+    writer.Write(42);
+    writer.EndArray();
+    writer.WriteMembers(tail);
+    writer.EndObject();
+    BOOST_CHECK_EQUAL(ss.str(), write_string(Value(expected), false));
+
+    std::ostringstream ssEmpty;
+    CJSONStreamWriter writerEmpty(ssEmpty);
+    writerEmpty.BeginArray();
+    writerEmpty.EndArray();
+    BOOST_CHECK_EQUAL(ssEmpty.str(), "[]");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
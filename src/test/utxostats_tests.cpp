@@ -0,0 +1,160 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "txdb.h"
+#include "undo.h"
+#include "utiltime.h"
+#include "utxostats.h"
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(utxostats_tests)
+
+static CMutableTransaction MakeTx(const COutPoint& prevout, unsigned int nOutputs, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    if (prevout.IsNull())
+        tx.vin[0].scriptSig = CScript() << nValue;
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = nValue + i;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return tx;
+}
+
+// Apply block to tip the way ConnectTip does and tell tracker about it
+static void ConnectToTip(CUTXOStatsTracker& tracker, const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& tip)
+{
+    CCoinsViewCache view(&tip);
+    CValidationState state;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        CTxUndo undo;
+        UpdateCoins(tx, state, view, undo, pindex->nHeight);
+    }
+    view.SetBestBlock(pindex->GetBlockHash());
+    tracker.BlockConnected(block, pindex, tip, view);
+    BOOST_CHECK(view.Flush());
+}
+
+// Wait for a background scan started by tracker to finish
+static bool WaitForStats(const CUTXOStatsTracker& tracker, CUTXOSetStats& stats)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (tracker.Get(stats))
+            return true;
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(utxostats_tracking)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache tip(&db);
+    CUTXOStatsTracker tracker;
+    {
+        LOCK(cs_main);
+        tracker.Start(db, 0);
+    }
+
+    CUTXOSetStats stats;
+    BOOST_CHECK(tracker.Get(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+
+    uint256 hash1 = uint256(1), hash2 = uint256(2);
+    CBlockIndex index1, index2;
+    index1.phashBlock = &hash1;
+    index1.nHeight = 1;
+    index2.phashBlock = &hash2;
+    index2.nHeight = 2;
+    index2.pprev = &index1;
+
+    // Block 1 creates two transactions with three outputs in total
+    CBlock block1;
+    block1.vtx.push_back(MakeTx(COutPoint(), 2, 100));
+    block1.vtx.push_back(MakeTx(COutPoint(), 1, 1000));
+    ConnectToTip(tracker, block1, &index1, tip);
+
+    CUTXOSetStats stats1;
+    BOOST_CHECK(tracker.Get(stats1));
+    BOOST_CHECK(stats1.hashBlock == hash1);
+    BOOST_CHECK_EQUAL(stats1.nTransactions, 2U);
+    BOOST_CHECK_EQUAL(stats1.nTransactionOutputs, 3U);
+    BOOST_CHECK_EQUAL(stats1.nTotalAmount, 100 + 101 + 1000);
+
+    // Block 2 spends the second transaction completely, and spends its own output
+    CBlock block2;
+    block2.vtx.push_back(MakeTx(COutPoint(), 1, 50));
+    block2.vtx.push_back(MakeTx(COutPoint(block1.vtx[1].GetHash(), 0), 2, 400));
+    block2.vtx.push_back(MakeTx(COutPoint(block2.vtx[1].GetHash(), 1), 1, 300));
+    ConnectToTip(tracker, block2, &index2, tip);
+
+    BOOST_CHECK(tracker.Get(stats));
+    BOOST_CHECK_EQUAL(stats.nHeight, 2);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 4U);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 5U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 100 + 101 + 50 + 400 + 300);
+
+    // A full scan of the flushed database agrees with the tracked statistics
+    BOOST_CHECK(tip.Flush());
+    CUTXOSetStats scanned;
+    {
+        LOCK(cs_main);
+        tracker.Flushed(db);
+        boost::scoped_ptr<CCoinsViewDBSnapshot> pview(db.GetSnapshot());
+        BOOST_CHECK(pview->GetUTXOSetStats(scanned));
+    }
+    BOOST_CHECK(scanned.SameSet(stats));
+
+    // Disconnecting block 2 brings back the statistics of block 1
+    {
+        CCoinsViewCache view(&tip);
+        for (unsigned int i = 0; i < block2.vtx.size(); i++)
+            view.ModifyCoins(block2.vtx[i].GetHash())->Clear();
+        *view.ModifyCoins(block1.vtx[1].GetHash()) = CCoins(block1.vtx[1], 1);
+        view.SetBestBlock(hash1);
+        tracker.BlockDisconnected(block2, &index1, tip, view);
+        BOOST_CHECK(view.Flush());
+    }
+    BOOST_CHECK(tracker.Get(stats));
+    BOOST_CHECK(stats.hashBlock == hash1);
+    BOOST_CHECK(stats.SameSet(stats1));
+    BOOST_CHECK(tip.Flush());
+    {
+        LOCK(cs_main);
+        tracker.Flushed(db);
+    }
+    tracker.Stop();
+
+    // The stored statistics are picked up again when they belong to the best block
+    {
+        LOCK(cs_main);
+        tracker.Start(db, 0);
+    }
+    BOOST_CHECK(tracker.Get(stats));
+    BOOST_CHECK(stats.SameSet(stats1));
+    tracker.Stop();
+
+    // Otherwise they are computed by a background scan
+    CCoinsViewCache viewReconnect(&tip);
+    viewReconnect.SetBestBlock(hash2);
+    BOOST_CHECK(viewReconnect.Flush());
+    BOOST_CHECK(tip.Flush());
+    {
+        LOCK(cs_main);
+        tracker.Start(db, 0);
+    }
+    BOOST_CHECK(WaitForStats(tracker, stats));
+    BOOST_CHECK(stats.hashBlock == hash2);
+    BOOST_CHECK(stats.SameSet(stats1));
+    tracker.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include "wallet.h"
 
+#include "main.h"
+
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -305,4 +307,147 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+
+// Outputs AvailableCoins() would return found by walking the whole wallet, as it did before the unspent index
+static set<COutPoint> recompute_available(const CWallet& w)
+{
+    set<COutPoint> setRet;
+    LOCK2(cs_main, w.cs_wallet);
+    for (map<uint256, CWalletTx>::const_iterator it = w.mapWallet.begin(); it != w.mapWallet.end(); ++it) {
+        const CWalletTx& wtx = it->second;
+        if (!CheckFinalTx(wtx) || !wtx.IsTrusted())
+            continue;
+        int nDepth = wtx.GetDepthInMainChain(false);
+        if (nDepth == 0 && !wtx.InMempool())
+            continue;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            if (!w.IsSpent(it->first, i) && w.IsMine(wtx.vout[i]) != ISMINE_NO &&
+                !w.IsLockedCoin(it->first, i) && wtx.vout[i].nValue > 0)
+                setRet.insert(COutPoint(it->first, i));
+        }
+    }
+    return setRet;
+}
+
+static set<COutPoint> available(const CWallet& w)
+{
+    vector<COutput> vAvailable;
+    w.AvailableCoins(vAvailable);
+    set<COutPoint> setRet;
+    BOOST_FOREACH (const COutput& out, vAvailable)
+        setRet.insert(COutPoint(out.tx->GetHash(), out.i));
+    return setRet;
+}
+
+BOOST_AUTO_TEST_CASE(unspent_index_tests)
+{
+    CWallet w("wallet_unspent_index.dat");
+    bool fFirstRun;
+    w.LoadWallet(fFirstRun);
+    CKey key1, key2, keyOther;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    {
+        LOCK(w.cs_wallet);
+        BOOST_CHECK(w.AddKeyPubKey(key1, key1.GetPubKey()));
+    }
+
+    // Blocks on top of the current tip, each confirming a single transaction
+    CBlockIndex* pindexOrigTip;
+    {
+        LOCK(cs_main);
+        pindexOrigTip = chainActive.Tip();
+    }
+    vector<uint256> vHashes(3);
+    vector<CBlockIndex> vBlocks(3);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        vHashes[i] = uint256(1000 + i);
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].pprev = i ? &vBlocks[i - 1] : pindexOrigTip;
+        vBlocks[i].nHeight = vBlocks[i].pprev->nHeight + 1;
+        vBlocks[i].nTime = vBlocks[i].pprev->nTime + 60;
+    }
+
+    vector<CMutableTransaction> vTx(3);
+    vTx[0].vin.resize(1);
+    vTx[0].vin[0].prevout = COutPoint(uint256(1), 0);
+    vTx[0].vout.resize(3);
+    vTx[0].vout[0].scriptPubKey = GetScriptForDestination(key1.GetPubKey().GetID());
+    vTx[0].vout[1].scriptPubKey = GetScriptForDestination(key1.GetPubKey().GetID());
+    vTx[0].vout[2].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    vTx[1].vin.resize(1);
+    vTx[1].vin[0].prevout = COutPoint(uint256(2), 0);
+    vTx[1].vout.resize(1);
+    vTx[1].vout[0].scriptPubKey = GetScriptForDestination(key2.GetPubKey().GetID());
+    vTx[2].vin.resize(1);
+    vTx[2].vin[0].prevout = COutPoint(CTransaction(vTx[0]).GetHash(), 0);
+    vTx[2].vout.resize(1);
+    vTx[2].vout[0].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    for (unsigned int i = 0; i < vTx.size(); i++) {
+        BOOST_FOREACH (CTxOut& out, vTx[i].vout)
+            out.nValue = (i + 1) * COIN;
+        vBlocks[i].hashMerkleRoot = CTransaction(vTx[i]).GetHash();
+    }
+
+    {
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < vBlocks.size(); i++)
+            mapBlockIndex[vHashes[i]] = &vBlocks[i];
+        chainActive.SetTip(&vBlocks[1]);
+    }
+
+    // Receiving transactions, one of them to a key the wallet doesn't have yet
+    for (unsigned int i = 0; i < 2; i++) {
+        CWalletTx wtx(&w, vTx[i]);
+        wtx.hashBlock = vHashes[i];
+        wtx.nIndex = 0;
+        BOOST_CHECK(w.AddToWallet(wtx));
+    }
+    BOOST_CHECK_EQUAL(available(w).size(), 2U);
+    BOOST_CHECK(available(w) == recompute_available(w));
+
+    // Importing that key makes its output available
+    {
+        LOCK(w.cs_wallet);
+        BOOST_CHECK(w.AddKeyPubKey(key2, key2.GetPubKey()));
+    }
+    BOOST_CHECK_EQUAL(available(w).size(), 3U);
+    BOOST_CHECK(available(w) == recompute_available(w));
+
+    // A new key changes nothing
+    {
+        LOCK(w.cs_wallet);
+        w.GenerateNewKey();
+    }
+    BOOST_CHECK(available(w) == recompute_available(w));
+
+    // A confirmed spend removes the output
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&vBlocks[2]);
+    }
+    CWalletTx wtxSpend(&w, vTx[2]);
+    wtxSpend.hashBlock = vHashes[2];
+    wtxSpend.nIndex = 0;
+    BOOST_CHECK(w.AddToWallet(wtxSpend));
+    BOOST_CHECK_EQUAL(available(w).size(), 2U);
+    BOOST_CHECK(available(w) == recompute_available(w));
+
+    // Disconnecting the block of the spend brings it back
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(&vBlocks[1]);
+    }
+    BOOST_CHECK_EQUAL(available(w).size(), 3U);
+    BOOST_CHECK(available(w) == recompute_available(w));
+
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexOrigTip);
+        for (unsigned int i = 0; i < vBlocks.size(); i++)
+            mapBlockIndex.erase(vHashes[i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 
@@ -28,7 +29,35 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+/** Options of the database called strName, e.g. -chainstatemaxopenfiles, starting from the role's defaults */
+static CLevelDBOptions GetDBOptionsFromArgs(const std::string& strName, const CLevelDBOptions& defaults)
+{
+    CLevelDBOptions dbOptions;
+    dbOptions.nMaxOpenFiles = std::max((int64_t)16, GetArg("-" + strName + "maxopenfiles", defaults.nMaxOpenFiles));
+    dbOptions.nBlockSize = std::max((int64_t)1, GetArg("-" + strName + "blocksize", defaults.nBlockSize >> 10)) << 10;
+    dbOptions.nWriteBufferSize = std::max((int64_t)0, GetArg("-" + strName + "writebuffer", defaults.nWriteBufferSize >> 20)) << 20;
+    dbOptions.nBlockCacheShare = std::min(std::max((int64_t)0, GetArg("-" + strName + "blockcache", defaults.nBlockCacheShare)), (int64_t)100);
+    dbOptions.fCompression = GetBoolArg("-" + strName + "compression", defaults.fCompression);
+    return dbOptions;
+}
+
+CLevelDBOptions GetChainstateDBOptions()
+{
+    CLevelDBOptions defaults;
+    defaults.nMaxOpenFiles = DEFAULT_CHAINSTATE_MAX_OPEN_FILES;
+    defaults.nBlockCacheShare = DEFAULT_CHAINSTATE_BLOCK_CACHE;
+    return GetDBOptionsFromArgs("chainstate", defaults);
+}
+
+CLevelDBOptions GetBlockIndexDBOptions()
+{
+    CLevelDBOptions defaults;
+    defaults.nMaxOpenFiles = DEFAULT_BLOCKINDEX_MAX_OPEN_FILES;
+    defaults.nBlockCacheShare = DEFAULT_BLOCKINDEX_BLOCK_CACHE;
+    return GetDBOptionsFromArgs("blockindex", defaults);
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBOptions& dbOptions) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, dbOptions)
 {
 }
 
@@ -71,7 +100,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBOptions& dbOptions) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, dbOptions)
 {
 }
 
@@ -114,16 +143,12 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+/** Hash and count the coins pcursor walks over, on top of stats.hashBlock */
+static bool GetStatsFromCursor(leveldb::Iterator* pcursor, CCoinsStats& stats)
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
     pcursor->SeekToFirst();
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
@@ -162,12 +187,106 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
+bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+{
+    /* It seems that there are no "const iterators" for LevelDB.  Since we
+       only need read operations on it, use a const-cast to get around
+       that restriction.  */
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    stats.hashBlock = GetBestBlock();
+    if (!GetStatsFromCursor(pcursor.get(), stats))
+        return false;
+    stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    return true;
+}
+
+bool CCoinsViewDB::ReadUTXOStats(CUTXOSetStats& stats) const
+{
+    return db.Read('S', stats);
+}
+
+bool CCoinsViewDB::WriteUTXOStats(const CUTXOSetStats& stats)
+{
+    return db.Write('S', stats);
+}
+
+CCoinsViewDBSnapshot* CCoinsViewDB::GetSnapshot() const
+{
+    return new CCoinsViewDBSnapshot(db);
+}
+
+CCoinsViewDBSnapshot::CCoinsViewDBSnapshot(const CLevelDBWrapper& db) : snapshot(db), nHeight(-1)
+{
+    AssertLockHeld(cs_main);
+    if (!snapshot.Read('B', hashBestBlock))
+        hashBestBlock = uint256();
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashBestBlock);
+    if (mi != mapBlockIndex.end())
+        nHeight = mi->second->nHeight;
+}
+
+bool CCoinsViewDBSnapshot::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    return snapshot.Read(make_pair('c', txid), coins);
+}
+
+bool CCoinsViewDBSnapshot::HaveCoins(const uint256& txid) const
+{
+    CCoins coins;
+    return GetCoins(txid, coins);
+}
+
+bool CCoinsViewDBSnapshot::GetStats(CCoinsStats& stats) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot.NewIterator());
+    stats.hashBlock = hashBestBlock;
+    if (!GetStatsFromCursor(pcursor.get(), stats))
+        return false;
+    stats.nHeight = nHeight;
+    return true;
+}
+
+bool CCoinsViewDBSnapshot::GetUTXOSetStats(CUTXOSetStats& stats) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(snapshot.NewIterator());
+    pcursor->SeekToFirst();
+
+    stats.SetNull();
+    stats.hashBlock = hashBestBlock;
+    stats.nHeight = nHeight;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType == 'c') {
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CCoins coins;
+                ssValue >> coins;
+                uint256 txhash;
+                ssKey >> txhash;
+                stats.nTransactions++;
+                for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                    if (!coins.vout[i].IsNull())
+                        stats.AddOutput(COutPoint(txhash, i), coins.vout[i]);
+                }
+            }
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
 {
     return Read(make_pair('t', txid), pos);
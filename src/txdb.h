@@ -23,6 +23,21 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -chainstatemaxopenfiles default: coins are looked up all over the database, keep its tables open
+static const int DEFAULT_CHAINSTATE_MAX_OPEN_FILES = sizeof(void*) > 4 ? 1000 : DEFAULT_LEVELDB_MAX_OPEN_FILES;
+//! -chainstateblockcache default (%), most coin reads are already served by pcoinsTip
+static const int DEFAULT_CHAINSTATE_BLOCK_CACHE = 25;
+//! -blockindexmaxopenfiles default
+static const int DEFAULT_BLOCKINDEX_MAX_OPEN_FILES = DEFAULT_LEVELDB_MAX_OPEN_FILES;
+//! -blockindexblockcache default (%), the transaction index is read through the block cache
+static const int DEFAULT_BLOCKINDEX_BLOCK_CACHE = 50;
+
+/** LevelDB tuning of chainstate/ and blocks/index/ from their -chainstate* and -blockindex* options */
+CLevelDBOptions GetChainstateDBOptions();
+CLevelDBOptions GetBlockIndexDBOptions();
+
+class CCoinsViewDBSnapshot;
+class CUTXOSetStats;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -31,20 +46,53 @@ protected:
     CLevelDBWrapper db;
 
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBOptions& dbOptions = CLevelDBOptions());
+
+    const CLevelDBWrapper& GetDB() const { return db; }
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    /** UTXO set statistics kept by CUTXOStatsTracker, valid when they are for the best block */
+    bool ReadUTXOStats(CUTXOSetStats& stats) const;
+    bool WriteUTXOStats(const CUTXOSetStats& stats);
+
+    /**
+     * Read view of the database as it is now, for long queries that should not
+     * hold cs_main. Flush pcoinsTip first to see the current tip. Caller owns it.
+     */
+    CCoinsViewDBSnapshot* GetSnapshot() const;
+};
+
+/** Frozen view of the coin database, paired with the best block it corresponds to */
+class CCoinsViewDBSnapshot : public CCoinsView
+{
+private:
+    CLevelDBSnapshot snapshot;
+    uint256 hashBestBlock;
+    int nHeight;
+
+public:
+    //! Must be created with cs_main held, the height of the best block is looked up here
+    explicit CCoinsViewDBSnapshot(const CLevelDBWrapper& db);
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const { return hashBestBlock; }
+    int GetBestHeight() const { return nHeight; }
+    bool GetStats(CCoinsStats& stats) const;
+    //! Count and hash the unspent outputs for CUTXOStatsTracker
+    bool GetUTXOSetStats(CUTXOSetStats& stats) const;
 };
 
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CLevelDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBOptions& dbOptions = CLevelDBOptions());
 
 private:
     CBlockTreeDB(const CBlockTreeDB&);
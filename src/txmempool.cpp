@@ -16,16 +16,23 @@
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0),
+                                     nCountWithAncestors(1), nSizeWithAncestors(0), nModFeesWithAncestors(0),
+                                     nCountWithDescendants(1), nSizeWithDescendants(0), nModFeesWithDescendants(0), dIndexedPriority(0.0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nCountWithAncestors = nCountWithDescendants = 1;
+    nSizeWithAncestors = nSizeWithDescendants = nTxSize;
+    nModFeesWithAncestors = nModFeesWithDescendants = nFee;
+    dIndexedPriority = 0.0;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -355,7 +362,8 @@ public:
 
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) : nTransactionsUpdated(0),
-                                                       minRelayFee(_minRelayFee)
+                                                       minRelayFee(_minRelayFee),
+                                                       nPriorityHeight(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -401,6 +409,99 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+static CMemPoolScore AncestorScore(const CTxMemPoolEntry& entry)
+{
+    return CMemPoolScore(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors(), entry.GetTx().GetHash());
+}
+
+static CMemPoolScore DescendantScore(const CTxMemPoolEntry& entry)
+{
+    // A package is only as cheap to evict as the better of the transaction and its descendants
+    CMemPoolScore own(entry.GetModifiedFee(), entry.GetTxSize(), entry.GetTx().GetHash());
+    CMemPoolScore package(entry.GetModFeesWithDescendants(), entry.GetSizeWithDescendants(), entry.GetTx().GetHash());
+    return package < own ? own : package;
+}
+
+double CTxMemPool::IndexedPriority(const CTxMemPoolEntry& entry) const
+{
+    // Entries may be younger than the index after a reorg
+    double dPriority = entry.GetPriority(std::max(nPriorityHeight, entry.GetHeight()));
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(entry.GetTx().GetHash());
+    if (pos != mapDeltas.end())
+        dPriority += pos->second.first;
+    return dPriority;
+}
+
+void CTxMemPool::addToIndexes(CTxMemPoolEntry& entry)
+{
+    const uint256& hash = entry.GetTx().GetHash();
+    setByFeeRate.insert(CMemPoolScore(entry.GetModifiedFee(), entry.GetTxSize(), hash));
+    setByAncestorScore.insert(AncestorScore(entry));
+    setByDescendantScore.insert(DescendantScore(entry));
+    setByEntryTime.insert(std::make_pair(entry.GetTime(), hash));
+    entry.dIndexedPriority = IndexedPriority(entry);
+    setByPriority.insert(std::make_pair(entry.dIndexedPriority, hash));
+}
+
+void CTxMemPool::removeFromIndexes(const CTxMemPoolEntry& entry)
+{
+    const uint256& hash = entry.GetTx().GetHash();
+    setByFeeRate.erase(CMemPoolScore(entry.GetModifiedFee(), entry.GetTxSize(), hash));
+    setByAncestorScore.erase(AncestorScore(entry));
+    setByDescendantScore.erase(DescendantScore(entry));
+    setByEntryTime.erase(std::make_pair(entry.GetTime(), hash));
+    setByPriority.erase(std::make_pair(entry.dIndexedPriority, hash));
+}
+
+void CTxMemPool::CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const
+{
+    LOCK(cs);
+    std::vector<const CTransaction*> vToVisit(1, &tx);
+    while (!vToVisit.empty()) {
+        const CTransaction* ptx = vToVisit.back();
+        vToVisit.pop_back();
+        BOOST_FOREACH (const CTxIn& txin, ptx->vin) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end() && setAncestors.insert(it->first).second)
+                vToVisit.push_back(&it->second.GetTx());
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    LOCK(cs);
+    std::vector<uint256> vToVisit(1, hash);
+    while (!vToVisit.empty()) {
+        uint256 hashCur = vToVisit.back();
+        vToVisit.pop_back();
+        std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.lower_bound(COutPoint(hashCur, 0));
+        for (; it != mapNextTx.end() && it->first.hash == hashCur; ++it) {
+            const uint256& hashChild = it->second.ptx->GetHash();
+            if (setDescendants.insert(hashChild).second)
+                vToVisit.push_back(hashChild);
+        }
+    }
+}
+
+void CTxMemPool::UpdateAncestorState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees)
+{
+    removeFromIndexes(entry);
+    entry.nCountWithAncestors += nCount;
+    entry.nSizeWithAncestors += nSize;
+    entry.nModFeesWithAncestors += nModFees;
+    addToIndexes(entry);
+}
+
+void CTxMemPool::UpdateDescendantState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees)
+{
+    removeFromIndexes(entry);
+    entry.nCountWithDescendants += nCount;
+    entry.nSizeWithDescendants += nSize;
+    entry.nModFeesWithDescendants += nModFees;
+    addToIndexes(entry);
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
@@ -408,12 +509,68 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
+        if (mapTx.count(hash)) {
+            CTransaction txOld = mapTx[hash].GetTx();
+            std::list<CTransaction> dummy;
+            remove(txOld, dummy, false);
+        }
+
+        // A transaction brought back by a reorg may already have children in
+        // the pool. Note their ancestors from before it is linked in, to tell
+        // which of its ancestors are new to them.
+        std::set<uint256> setDescendants;
+        CalculateDescendants(hash, setDescendants);
+        std::map<uint256, std::set<uint256> > mapOldAncestors;
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+            CalculateAncestors(mapTx[hashDescendant].GetTx(), mapOldAncestors[hashDescendant]);
+
         mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
+        CTxMemPoolEntry& newEntry = mapTx[hash];
+        const CTransaction& tx = newEntry.GetTx();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
+
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(hash);
+        if (pos != mapDeltas.end())
+            newEntry.nFeeDelta = pos->second.second;
+
+        // Package state: the new transaction joins the descendant package of
+        // each of its ancestors
+        std::set<uint256> setAncestors;
+        CalculateAncestors(tx, setAncestors);
+        newEntry.nCountWithDescendants = 1;
+        newEntry.nSizeWithDescendants = newEntry.GetTxSize();
+        newEntry.nModFeesWithDescendants = newEntry.GetModifiedFee();
+        newEntry.nCountWithAncestors = 1;
+        newEntry.nSizeWithAncestors = newEntry.GetTxSize();
+        newEntry.nModFeesWithAncestors = newEntry.GetModifiedFee();
+        BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+            CTxMemPoolEntry& ancestor = mapTx[hashAncestor];
+            newEntry.nCountWithAncestors++;
+            newEntry.nSizeWithAncestors += ancestor.GetTxSize();
+            newEntry.nModFeesWithAncestors += ancestor.GetModifiedFee();
+            UpdateDescendantState(ancestor, 1, newEntry.GetTxSize(), newEntry.GetModifiedFee());
+        }
+        // ... and its descendants get it and its ancestors they did not have yet
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+            CTxMemPoolEntry& descendant = mapTx[hashDescendant];
+            newEntry.nCountWithDescendants++;
+            newEntry.nSizeWithDescendants += descendant.GetTxSize();
+            newEntry.nModFeesWithDescendants += descendant.GetModifiedFee();
+            UpdateAncestorState(descendant, 1, newEntry.GetTxSize(), newEntry.GetModifiedFee());
+
+            const std::set<uint256>& setOldAncestors = mapOldAncestors[hashDescendant];
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (setOldAncestors.count(hashAncestor))
+                    continue;
+                CTxMemPoolEntry& ancestor = mapTx[hashAncestor];
+                UpdateAncestorState(descendant, 1, ancestor.GetTxSize(), ancestor.GetModifiedFee());
+                UpdateDescendantState(ancestor, 1, descendant.GetTxSize(), descendant.GetModifiedFee());
+            }
+        }
+        addToIndexes(newEntry);
     }
     return true;
 }
@@ -438,13 +595,18 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                 txToRemove.push_back(it->second.ptx->GetHash());
             }
         }
+        // Collect everything to be removed first, so the relatives that stay in
+        // the pool only have the removed transactions taken off their package state
+        std::vector<uint256> vRemove;
+        std::set<uint256> setRemove;
         while (!txToRemove.empty()) {
             uint256 hash = txToRemove.front();
             txToRemove.pop_front();
-            if (!mapTx.count(hash))
+            if (!mapTx.count(hash) || !setRemove.insert(hash).second)
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
+            vRemove.push_back(hash);
             if (fRecursive) {
+                const CTransaction& tx = mapTx[hash].GetTx();
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
                     std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
                     if (it == mapNextTx.end())
@@ -452,17 +614,61 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
             }
+        }
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            const CTxMemPoolEntry& entry = mapTx[hash];
+            std::set<uint256> setAncestors, setDescendants;
+            CalculateAncestors(entry.GetTx(), setAncestors);
+            // Descendants are removed as well when recursing
+            if (!fRecursive)
+                CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+                if (!setRemove.count(hashAncestor))
+                    UpdateDescendantState(mapTx[hashAncestor], -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+            }
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+                if (!setRemove.count(hashDescendant))
+                    UpdateAncestorState(mapTx[hashDescendant], -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
+            }
+        }
+        BOOST_FOREACH (const uint256& hash, vRemove) {
+            const CTransaction& tx = mapTx[hash].GetTx();
             BOOST_FOREACH (const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
 
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
+            removeFromIndexes(mapTx[hash]);
             mapTx.erase(hash);
             nTransactionsUpdated++;
         }
     }
 }
 
+int CTxMemPool::Expire(int64_t nTime, std::list<CTransaction>& removed)
+{
+    LOCK(cs);
+    std::vector<CTransaction> vExpired;
+    std::set<std::pair<int64_t, uint256> >::const_iterator it = setByEntryTime.begin();
+    for (; it != setByEntryTime.end() && it->first < nTime; ++it)
+        vExpired.push_back(mapTx[it->second].GetTx());
+
+    size_t nRemovedBefore = removed.size();
+    BOOST_FOREACH (const CTransaction& tx, vExpired)
+        remove(tx, removed, true);
+    return removed.size() - nRemovedBefore;
+}
+
+void CTxMemPool::TrimToSize(uint64_t nSizeLimit, std::list<CTransaction>& removed)
+{
+    LOCK(cs);
+    while (totalTxSize > nSizeLimit && !setByDescendantScore.empty()) {
+        // Evict the cheapest package: the entry and everything that depends on it
+        CTransaction tx = mapTx[setByDescendantScore.begin()->hash].GetTx();
+        remove(tx, removed, true);
+    }
+}
+
 void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight)
 {
     // Remove transactions spending a coinbase which are now immature
@@ -526,6 +732,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
+
+    // Re-key the priority index for the next block, once per block rather
+    // than every time the miner assembles a template
+    nPriorityHeight = nBlockHeight + 1;
+    setByPriority.clear();
+    for (std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        it->second.dIndexedPriority = IndexedPriority(it->second);
+        setByPriority.insert(std::make_pair(it->second.dIndexedPriority, it->first));
+    }
 }
 
 
@@ -534,6 +749,11 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    setByFeeRate.clear();
+    setByAncestorScore.clear();
+    setByDescendantScore.clear();
+    setByEntryTime.clear();
+    setByPriority.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -610,6 +830,39 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+
+    // Indexes and package state must match the pool
+    assert(setByFeeRate.size() == mapTx.size());
+    assert(setByAncestorScore.size() == mapTx.size());
+    assert(setByDescendantScore.size() == mapTx.size());
+    assert(setByEntryTime.size() == mapTx.size());
+    assert(setByPriority.size() == mapTx.size());
+    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        std::set<uint256> setAncestors, setDescendants;
+        CalculateAncestors(it->second.GetTx(), setAncestors);
+        CalculateDescendants(it->first, setDescendants);
+        uint64_t nSizeAncestors = it->second.GetTxSize(), nSizeDescendants = it->second.GetTxSize();
+        CAmount nFeesAncestors = it->second.GetModifiedFee(), nFeesDescendants = it->second.GetModifiedFee();
+        BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+            const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+            nSizeAncestors += ancestor.GetTxSize();
+            nFeesAncestors += ancestor.GetModifiedFee();
+        }
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+            const CTxMemPoolEntry& descendant = mapTx.find(hashDescendant)->second;
+            nSizeDescendants += descendant.GetTxSize();
+            nFeesDescendants += descendant.GetModifiedFee();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeAncestors);
+        assert(it->second.GetModFeesWithAncestors() == nFeesAncestors);
+        assert(it->second.GetCountWithDescendants() == setDescendants.size() + 1);
+        assert(it->second.GetSizeWithDescendants() == nSizeDescendants);
+        assert(it->second.GetModFeesWithDescendants() == nFeesDescendants);
+        assert(setByAncestorScore.count(AncestorScore(it->second)));
+        assert(setByDescendantScore.count(DescendantScore(it->second)));
+        assert(setByPriority.count(std::make_pair(it->second.dIndexedPriority, it->first)));
+    }
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -680,6 +933,27 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+        if (it != mapTx.end()) {
+            // Re-key the entry; a fee delta also moves its own package state
+            CTxMemPoolEntry& entry = it->second;
+            removeFromIndexes(entry);
+            entry.nFeeDelta = deltas.second;
+            entry.nModFeesWithAncestors += nFeeDelta;
+            entry.nModFeesWithDescendants += nFeeDelta;
+            addToIndexes(entry);
+            if (nFeeDelta != 0) {
+                // ... and that of its relatives
+                std::set<uint256> setAncestors, setDescendants;
+                CalculateAncestors(entry.GetTx(), setAncestors);
+                CalculateDescendants(hash, setDescendants);
+                BOOST_FOREACH (const uint256& hashAncestor, setAncestors)
+                    UpdateDescendantState(mapTx[hashAncestor], 0, 0, nFeeDelta);
+                BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+                    UpdateAncestorState(mapTx[hashDescendant], 0, 0, nFeeDelta);
+            }
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -7,6 +7,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -36,6 +37,8 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
  */
 class CTxMemPoolEntry
 {
+    friend class CTxMemPool;
+
 private:
     CTransaction tx;
     CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
@@ -44,6 +47,16 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee delta from PrioritiseTransaction
+
+    //! Package state including this transaction, maintained by CTxMemPool
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    double dIndexedPriority; //! Key in CTxMemPool::setByPriority
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -53,11 +66,42 @@ public:
     const CTransaction& GetTx() const { return this->tx; }
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+};
+
+/**
+ * Sort key of the fee rate based mempool indexes: a fee over a size,
+ * compared without rounding, ties broken by txid.
+ */
+struct CMemPoolScore {
+    CAmount nFee;
+    uint64_t nSize;
+    uint256 hash;
+
+    CMemPoolScore(CAmount nFeeIn, uint64_t nSizeIn, const uint256& hashIn) : nFee(nFeeIn), nSize(nSizeIn), hash(hashIn) {}
+
+    bool operator<(const CMemPoolScore& b) const
+    {
+        double f1 = (double)nFee * b.nSize;
+        double f2 = (double)b.nFee * nSize;
+        if (f1 == f2)
+            return hash < b.hash;
+        return f1 < f2;
+    }
 };
 
+typedef std::set<CMemPoolScore> CMemPoolScoreIndex;
+
 class CMinerPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -100,6 +144,15 @@ private:
 
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
+    unsigned int nPriorityHeight; //! Height setByPriority is keyed for
+
+    void addToIndexes(CTxMemPoolEntry& entry);
+    void removeFromIndexes(const CTxMemPoolEntry& entry);
+    /** Adjust the ancestor (resp. descendant) package state of an entry by the given amounts, keeping the indexes in step */
+    void UpdateAncestorState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees);
+    void UpdateDescendantState(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees);
+    /** Priority of entry at nPriorityHeight, including its priority delta */
+    double IndexedPriority(const CTxMemPoolEntry& entry) const;
 
 public:
     mutable CCriticalSection cs;
@@ -107,6 +160,24 @@ public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+    /**
+     * Secondary indexes over mapTx, kept up to date by addUnchecked, remove and
+     * PrioritiseTransaction so block assembly and eviction need not rescan the pool:
+     *  - by the transaction's own modified fee rate
+     *  - by ancestor package fee rate (best first when iterated in reverse, for mining)
+     *  - by max(own, descendant package) fee rate (lowest first, for eviction)
+     *  - by entry time (oldest first, for expiry)
+     *  - by priority at the height of the next block (for the miner's priority area)
+     *
+     * Priorities grow at different rates as the chain advances, so setByPriority
+     * is re-keyed once per connected block by removeForBlock.
+     */
+    CMemPoolScoreIndex setByFeeRate;
+    CMemPoolScoreIndex setByAncestorScore;
+    CMemPoolScoreIndex setByDescendantScore;
+    std::set<std::pair<int64_t, uint256> > setByEntryTime;
+    std::set<std::pair<double, uint256> > setByPriority;
+
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -120,11 +191,24 @@ public:
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry);
+    /**
+     * Remove tx, and with fRecursive everything that depends on it. Without
+     * fRecursive the descendants stay, so tx's in-pool ancestors must be gone
+     * already, as when removing a block's transactions in block order.
+     */
     void remove(const CTransaction& tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction& tx, std::list<CTransaction>& removed);
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
     void clear();
+    /** Remove transactions that entered the pool before nTime (and their descendants). Returns the number removed. */
+    int Expire(int64_t nTime, std::list<CTransaction>& removed);
+    /** Evict lowest descendant score packages until the pool's transactions take at most nSizeLimit bytes */
+    void TrimToSize(uint64_t nSizeLimit, std::list<CTransaction>& removed);
+    /** In-pool ancestors of tx (not including tx itself) */
+    void CalculateAncestors(const CTransaction& tx, std::set<uint256>& setAncestors) const;
+    /** In-pool descendants of the transaction with the given hash (not including itself) */
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins& coins);
     unsigned int GetTransactionsUpdated() const;
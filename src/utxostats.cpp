@@ -0,0 +1,356 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <set>
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+CUTXOStatsTracker utxoStatsTracker;
+
+std::vector<unsigned char> UTXOSetElement(const COutPoint& outpoint, const CTxOut& txout)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << outpoint << txout;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+void CUTXOSetStats::AddOutput(const COutPoint& outpoint, const CTxOut& txout)
+{
+    std::vector<unsigned char> vElement = UTXOSetElement(outpoint, txout);
+    nTransactionOutputs++;
+    nTotalAmount += txout.nValue;
+    muhash.Insert(&vElement[0], vElement.size());
+}
+
+void CUTXOSetStats::Apply(const CUTXOSetStats& delta)
+{
+    // Unsigned counts wrap around, so a delta that went below zero still adds up
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nTotalAmount += delta.nTotalAmount;
+    muhash *= delta.muhash;
+}
+
+bool CUTXOSetStats::SameSet(const CUTXOSetStats& other) const
+{
+    return nTransactions == other.nTransactions &&
+           nTransactionOutputs == other.nTransactionOutputs &&
+           nTotalAmount == other.nTotalAmount &&
+           muhash == other.muhash;
+}
+
+CUTXOStatsTracker::CUTXOStatsTracker() : fValid(false), fStop(true), nSeqQueued(0), nSeqDone(0), fScanning(false), fScanRequested(false), nScanSeq(0),
+                                         nCheckInterval(DEFAULT_UTXOSTATS_CHECK_INTERVAL), nBlocksSinceCheck(0), nLastCheckHeight(-1), fLastCheckMatched(false)
+{
+}
+
+CUTXOStatsTracker::~CUTXOStatsTracker()
+{
+    Stop();
+}
+
+void CUTXOStatsTracker::Start(const CCoinsViewDB& db, int nCheckIntervalIn)
+{
+    Stop();
+
+    CUTXOSetStats stored;
+    bool fStored = db.ReadUTXOStats(stored);
+    uint256 hashBestBlock = db.GetBestBlock();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fStop = false;
+    nSeqQueued = nSeqDone = 0;
+    fScanning = fScanRequested = false;
+    nScanSeq = 0;
+    nCheckInterval = nCheckIntervalIn;
+    nBlocksSinceCheck = 0;
+    nLastCheckHeight = -1;
+    fLastCheckMatched = false;
+    stats.SetNull();
+    fValid = false;
+    threadHash = boost::thread(&CUTXOStatsTracker::ThreadHash, this);
+
+    if (hashBestBlock.IsNull()) {
+        // Empty coin database, nothing to count
+        fValid = true;
+    } else if (fStored && stored.hashBlock == hashBestBlock) {
+        stats = stored;
+        fValid = true;
+    } else {
+        LogPrintf("Computing UTXO set statistics in the background\n");
+        StartScan(db);
+    }
+}
+
+void CUTXOStatsTracker::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+        cond.notify_all();
+    }
+    // The hashing thread finishes the queue before it exits
+    threadScan.interrupt();
+    if (threadScan.joinable())
+        threadScan.join();
+    if (threadHash.joinable())
+        threadHash.join();
+}
+
+void CUTXOStatsTracker::WaitForHashes(boost::unique_lock<boost::mutex>& lock) const
+{
+    while (nSeqDone < nSeqQueued)
+        cond.wait(lock);
+}
+
+void CUTXOStatsTracker::ThreadHash()
+{
+    RenameThread("blocknetdx-utxohash");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (queuePending.empty() && !fStop)
+            cond.wait(lock);
+        if (queuePending.empty())
+            return;
+
+        CPendingHash pending;
+        pending.nSeq = queuePending.front().nSeq;
+        pending.vAdded.swap(queuePending.front().vAdded);
+        pending.vRemoved.swap(queuePending.front().vRemoved);
+        queuePending.pop_front();
+        cond.notify_all();
+        lock.unlock();
+
+        MuHash3072 muhash;
+        BOOST_FOREACH (const std::vector<unsigned char>& vElement, pending.vAdded)
+            muhash.Insert(&vElement[0], vElement.size());
+        BOOST_FOREACH (const std::vector<unsigned char>& vElement, pending.vRemoved)
+            muhash.Remove(&vElement[0], vElement.size());
+
+        lock.lock();
+        stats.muhash *= muhash;
+        if (fScanning && pending.nSeq > nScanSeq)
+            delta.muhash *= muhash;
+        nSeqDone = pending.nSeq;
+        cond.notify_all();
+    }
+}
+
+void CUTXOStatsTracker::StartScan(const CCoinsViewDB& db)
+{
+    if (fScanning)
+        return;
+    fScanRequested = false;
+    nBlocksSinceCheck = 0;
+
+    CCoinsViewDBSnapshot* pview = db.GetSnapshot();
+    if (fValid && pview->GetBestBlock() != stats.hashBlock) {
+        // The coin database is behind the tip, there is nothing to compare the scan with
+        delete pview;
+        return;
+    }
+    if (!fValid) {
+        stats.hashBlock = pview->GetBestBlock();
+        stats.nHeight = pview->GetBestHeight();
+    }
+    delta.SetNull();
+    nScanSeq = nSeqQueued;
+    fScanning = true;
+    if (threadScan.joinable())
+        threadScan.join();
+    threadScan = boost::thread(&CUTXOStatsTracker::ThreadScan, this, pview);
+}
+
+void CUTXOStatsTracker::ThreadScan(CCoinsViewDBSnapshot* pviewIn)
+{
+    RenameThread("blocknetdx-utxoscan");
+    boost::scoped_ptr<CCoinsViewDBSnapshot> pview(pviewIn);
+    int64_t nStart = GetTimeMillis();
+
+    CUTXOSetStats scanned;
+    bool fOk = false;
+    boost::unique_lock<boost::mutex> lock(mutex, boost::defer_lock);
+    try {
+        fOk = pview->GetUTXOSetStats(scanned);
+        lock.lock();
+        // Every change made since the snapshot has to be in delta before it is folded in
+        WaitForHashes(lock);
+    } catch (const boost::thread_interrupted&) {
+        if (!lock.owns_lock())
+            lock.lock();
+        fScanning = false;
+        return;
+    }
+    fScanning = false;
+    if (!fOk) {
+        LogPrintf("%s : scanning the coin database failed\n", __func__);
+        fScanRequested = !fValid;
+        return;
+    }
+
+    scanned.Apply(delta);
+    scanned.hashBlock = stats.hashBlock;
+    scanned.nHeight = stats.nHeight;
+    if (fValid) {
+        nLastCheckHeight = pview->GetBestHeight();
+        fLastCheckMatched = scanned.SameSet(stats);
+        if (fLastCheckMatched)
+            LogPrintf("UTXO set statistics verified at height %d in %dms\n", nLastCheckHeight, GetTimeMillis() - nStart);
+        else
+            LogPrintf("ERROR: %s : UTXO set statistics differ from a scan at height %d, replacing them\n", __func__, nLastCheckHeight);
+    } else {
+        LogPrintf("UTXO set statistics computed at height %d in %dms\n", pview->GetBestHeight(), GetTimeMillis() - nStart);
+    }
+    stats = scanned;
+    fValid = true;
+}
+
+void CUTXOStatsTracker::ApplyBlock(const CBlock& block, const CBlockIndex* pindexTip, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter, bool fConnect)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fStop)
+            return;
+    }
+
+    // Work out the change as if the block were connected and turn it around
+    // for a disconnect. The block's outputs are compared with the view that
+    // has the block applied only, so new transactions cost no database miss;
+    // outputs created and spent within the block appear on neither side.
+    const CCoinsViewCache& viewWith = fConnect ? viewAfter : viewBefore;
+    const CCoinsViewCache& viewWithout = fConnect ? viewBefore : viewAfter;
+
+    std::set<uint256> setBlockTx;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx)
+        setBlockTx.insert(tx.GetHash());
+
+    int64_t nTxChange = 0, nOutputChange = 0;
+    CAmount nAmountChange = 0;
+    std::vector<std::vector<unsigned char> > vCreated, vSpent;
+    std::set<uint256> setSpentTx;
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        const uint256& hash = tx.GetHash();
+        const CCoins* coins = viewWith.AccessCoins(hash);
+        if (coins && !coins->IsPruned()) {
+            nTxChange++;
+            for (unsigned int i = 0; i < coins->vout.size(); i++) {
+                if (coins->IsAvailable(i)) {
+                    nOutputChange++;
+                    nAmountChange += coins->vout[i].nValue;
+                    vCreated.push_back(UTXOSetElement(COutPoint(hash, i), coins->vout[i]));
+                }
+            }
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            const COutPoint& prevout = txin.prevout;
+            if (prevout.IsNull() || setBlockTx.count(prevout.hash))
+                continue;
+            coins = viewWithout.AccessCoins(prevout.hash);
+            if (!coins || !coins->IsAvailable(prevout.n))
+                continue;
+            nOutputChange--;
+            nAmountChange -= coins->vout[prevout.n].nValue;
+            vSpent.push_back(UTXOSetElement(prevout, coins->vout[prevout.n]));
+            if (setSpentTx.insert(prevout.hash).second) {
+                const CCoins* coinsWith = viewWith.AccessCoins(prevout.hash);
+                if (!coinsWith || coinsWith->IsPruned())
+                    nTxChange--;
+            }
+        }
+    }
+    if (!fConnect) {
+        nTxChange = -nTxChange;
+        nOutputChange = -nOutputChange;
+        nAmountChange = -nAmountChange;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fStop)
+        return;
+    while (queuePending.size() >= MAX_UTXOSTATS_QUEUE)
+        cond.wait(lock);
+
+    stats.hashBlock = pindexTip->GetBlockHash();
+    stats.nHeight = pindexTip->nHeight;
+    stats.nTransactions += nTxChange;
+    stats.nTransactionOutputs += nOutputChange;
+    stats.nTotalAmount += nAmountChange;
+    if (fScanning) {
+        delta.nTransactions += nTxChange;
+        delta.nTransactionOutputs += nOutputChange;
+        delta.nTotalAmount += nAmountChange;
+    }
+
+    queuePending.push_back(CPendingHash());
+    CPendingHash& pending = queuePending.back();
+    pending.nSeq = ++nSeqQueued;
+    pending.vAdded.swap(fConnect ? vCreated : vSpent);
+    pending.vRemoved.swap(fConnect ? vSpent : vCreated);
+    cond.notify_all();
+
+    if (fConnect && nCheckInterval > 0 && ++nBlocksSinceCheck >= nCheckInterval)
+        fScanRequested = true;
+}
+
+void CUTXOStatsTracker::BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter)
+{
+    ApplyBlock(block, pindex, viewBefore, viewAfter, true);
+}
+
+void CUTXOStatsTracker::BlockDisconnected(const CBlock& block, const CBlockIndex* pindexNew, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter)
+{
+    ApplyBlock(block, pindexNew, viewBefore, viewAfter, false);
+}
+
+void CUTXOStatsTracker::Flushed(CCoinsViewDB& db)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fStop)
+        return;
+    if (fScanRequested)
+        StartScan(db);
+    if (!fValid)
+        return;
+
+    WaitForHashes(lock);
+    CUTXOSetStats statsWrite = stats;
+    lock.unlock();
+    if (statsWrite.hashBlock == db.GetBestBlock())
+        db.WriteUTXOStats(statsWrite);
+}
+
+bool CUTXOStatsTracker::Get(CUTXOSetStats& statsOut) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fStop || !fValid)
+        return false;
+    WaitForHashes(lock);
+    statsOut = stats;
+    return true;
+}
+
+bool CUTXOStatsTracker::GetLastCheck(int& nHeight, bool& fMatched) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (nLastCheckHeight < 0)
+        return false;
+    nHeight = nLastCheckHeight;
+    fMatched = fLastCheckMatched;
+    return true;
+}
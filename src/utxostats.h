@@ -0,0 +1,159 @@
+// Copyright (c) 2015-2018 The Blocknet developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSTATS_H
+#define BITCOIN_UTXOSTATS_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CCoinsViewCache;
+class CCoinsViewDB;
+class CCoinsViewDBSnapshot;
+class COutPoint;
+class CTxOut;
+
+/** Default for -utxostatscheck, verify the tracked UTXO set statistics with a full scan every <n> blocks (0 = never) */
+static const int DEFAULT_UTXOSTATS_CHECK_INTERVAL = 0;
+/** Blocks whose set hash updates may be waiting for the hashing thread before block connection waits for it */
+static const unsigned int MAX_UTXOSTATS_QUEUE = 100;
+
+/** Serialization of one unspent output as an element of the UTXO set hash */
+std::vector<unsigned char> UTXOSetElement(const COutPoint& outpoint, const CTxOut& txout);
+
+/** Statistics of the unspent output set that can be updated output by output */
+class CUTXOSetStats
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    MuHash3072 muhash;
+
+    CUTXOSetStats() { SetNull(); }
+
+    void SetNull()
+    {
+        hashBlock.SetNull();
+        nHeight = -1;
+        nTransactions = 0;
+        nTransactionOutputs = 0;
+        nTotalAmount = 0;
+        muhash = MuHash3072();
+    }
+
+    void AddOutput(const COutPoint& outpoint, const CTxOut& txout);
+
+    /** Fold in the changes collected in delta, which may count down as well */
+    void Apply(const CUTXOSetStats& delta);
+
+    /** Whether both describe the same set, regardless of the block they are for */
+    bool SameSet(const CUTXOSetStats& other) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * Keeps the CUTXOSetStats of the chain tip current as blocks are connected and
+ * disconnected, so gettxoutsetinfo does not have to walk the coin database.
+ * Counts and amounts are updated in line; the set hash is updated by a
+ * background thread, as each output costs a 3072-bit multiplication.
+ *
+ * The statistics are stored next to the coins on every flush. When the stored
+ * ones do not belong to the database's best block, or every -utxostatscheck
+ * blocks, a full scan runs on a database snapshot in another thread. Changes
+ * made while it runs are collected apart and folded into its result, which
+ * works because none of the statistics depend on the order of updates.
+ */
+class CUTXOStatsTracker
+{
+private:
+    /** Set hash updates of one block */
+    struct CPendingHash {
+        uint64_t nSeq;
+        std::vector<std::vector<unsigned char> > vAdded;
+        std::vector<std::vector<unsigned char> > vRemoved;
+    };
+
+    mutable boost::mutex mutex;
+    mutable boost::condition_variable cond;
+
+    CUTXOSetStats stats; //!< of the chain tip, only usable when fValid
+    bool fValid;
+    bool fStop; //!< not started or shutting down
+
+    std::deque<CPendingHash> queuePending;
+    uint64_t nSeqQueued;
+    uint64_t nSeqDone;
+
+    CUTXOSetStats delta; //!< changes since the snapshot of the running scan
+    bool fScanning;
+    bool fScanRequested;
+    uint64_t nScanSeq; //!< last block update included in the running scan's snapshot
+    int nCheckInterval;
+    int nBlocksSinceCheck;
+    int nLastCheckHeight;
+    bool fLastCheckMatched;
+
+    boost::thread threadHash;
+    boost::thread threadScan;
+
+    void ThreadHash();
+    void ThreadScan(CCoinsViewDBSnapshot* pview);
+    void StartScan(const CCoinsViewDB& db);
+    void WaitForHashes(boost::unique_lock<boost::mutex>& lock) const;
+    void ApplyBlock(const CBlock& block, const CBlockIndex* pindexTip, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter, bool fConnect);
+
+public:
+    CUTXOStatsTracker();
+    ~CUTXOStatsTracker();
+
+    /** Load the statistics stored with db, or start computing them. Requires cs_main and an empty coins cache. */
+    void Start(const CCoinsViewDB& db, int nCheckIntervalIn);
+    /** Wait for pending hashing and abort a running scan */
+    void Stop();
+
+    /**
+     * Account for a block being applied to pcoinsTip. viewBefore is pcoinsTip and
+     * viewAfter the cache on top of it holding the block's changes, before it is
+     * flushed. Requires cs_main.
+     */
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter);
+    void BlockDisconnected(const CBlock& block, const CBlockIndex* pindexNew, const CCoinsViewCache& viewBefore, const CCoinsViewCache& viewAfter);
+
+    /** Store the statistics with db, just flushed to the chain tip, and start a requested scan. Requires cs_main. */
+    void Flushed(CCoinsViewDB& db);
+
+    /** Statistics of the chain tip, false while they are still being computed */
+    bool Get(CUTXOSetStats& statsOut) const;
+    /** Height of the last verification scan and whether it agreed, false if none ran */
+    bool GetLastCheck(int& nHeight, bool& fMatched) const;
+};
+
+extern CUTXOStatsTracker utxoStatsTracker;
+
+#endif // BITCOIN_UTXOSTATS_H
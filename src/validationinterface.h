@@ -31,7 +31,7 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
 
 class CValidationInterface {
 protected:
-    virtual void UpdatedBlockTip(const CBlockIndex *) {}
+    virtual void UpdatedBlockTip(const CBlockIndex *, const CBlock *) {}
     virtual void SyncTransaction(const CTransaction &, const CBlock *) {}
     virtual void NotifyTransactionLock(const CTransaction &) {}
     virtual void SetBestChain(const CBlockLocator &) {}
@@ -48,8 +48,8 @@ protected:
 };
 
 struct CMainSignals {
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of updated block chain tip, and the tip block itself if it is in memory */
+    boost::signals2::signal<void (const CBlockIndex *, const CBlock *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
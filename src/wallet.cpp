@@ -107,6 +107,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    fUnspentIndexDirty = true;
 
     // check if we need to remove from watch-only
     CScript script;
@@ -127,6 +128,7 @@ bool CWallet::AddCryptedKey(const CPubKey& vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    fUnspentIndexDirty = true;
     if (!fFileBacked)
         return true;
     {
@@ -153,6 +155,7 @@ bool CWallet::LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& meta)
 
 bool CWallet::LoadCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret)
 {
+    fUnspentIndexDirty = true;
     return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
 }
 
@@ -160,6 +163,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    fUnspentIndexDirty = true;
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -177,6 +181,7 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
+    fUnspentIndexDirty = true;
     return CCryptoKeyStore::AddCScript(redeemScript);
 }
 
@@ -184,6 +189,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fUnspentIndexDirty = true;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
@@ -196,6 +202,8 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    fUnspentIndexDirty = true;
+    MarkBalancesDirty();
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
@@ -207,6 +215,7 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
 
 bool CWallet::LoadWatchOnly(const CScript& dest)
 {
+    fUnspentIndexDirty = true;
     return CCryptoKeyStore::AddWatchOnly(dest);
 }
 
@@ -632,6 +641,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         AddToSpends(hash);
+        AddToUnspentIndex(hash, mapWallet[hash]);
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -712,6 +722,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        AddToUnspentIndex(hash, wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -770,8 +781,10 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkBalancesDirty();
+        }
     }
     return;
 }
@@ -1221,16 +1234,47 @@ void CWallet::ResendWalletTransactions()
  */
 
 
+bool CWallet::GetCachedBalance(BalanceType type, CAmount& nBalance) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Depth, maturity and trust change with the chain tip and the mempool
+    unsigned int nGeneration = nBalanceGeneration;
+    if (nCachedBalanceGeneration != nGeneration || pindexCachedBalance != chainActive.Tip() ||
+        nCachedBalanceMempool != mempool.GetTransactionsUpdated()) {
+        for (int i = 0; i < BALANCE_TYPE_COUNT; i++)
+            fCachedBalance[i] = false;
+        nCachedBalanceGeneration = nGeneration;
+        pindexCachedBalance = chainActive.Tip();
+        nCachedBalanceMempool = mempool.GetTransactionsUpdated();
+        return false;
+    }
+    if (!fCachedBalance[type])
+        return false;
+    nBalance = nCachedBalance[type];
+    return true;
+}
+
+void CWallet::SetCachedBalance(BalanceType type, CAmount nBalance) const
+{
+    nCachedBalance[type] = nBalance;
+    fCachedBalance[type] = true;
+}
+
 CAmount CWallet::GetBalance() const
 {
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_AVAILABLE, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
+        SetCachedBalance(BALANCE_AVAILABLE, nTotal);
     }
 
     return nTotal;
@@ -1243,12 +1287,15 @@ CAmount CWallet::GetAnonymizableBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_ANONYMIZABLE, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
 
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAnonymizableCredit();
         }
+        SetCachedBalance(BALANCE_ANONYMIZABLE, nTotal);
     }
 
     return nTotal;
@@ -1261,12 +1308,15 @@ CAmount CWallet::GetAnonymizedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_ANONYMIZED, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
 
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAnonymizedCredit();
         }
+        SetCachedBalance(BALANCE_ANONYMIZED, nTotal);
     }
 
     return nTotal;
@@ -1342,11 +1392,15 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        BalanceType type = unconfirmed ? BALANCE_DENOMINATED_UNCONFIRMED : BALANCE_DENOMINATED;
+        if (GetCachedBalance(type, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
 
             nTotal += pcoin->GetDenominatedCredit(unconfirmed);
         }
+        SetCachedBalance(type, nTotal);
     }
 
     return nTotal;
@@ -1357,11 +1411,14 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_UNCONFIRMED, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
+        SetCachedBalance(BALANCE_UNCONFIRMED, nTotal);
     }
     return nTotal;
 }
@@ -1371,10 +1428,13 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_IMMATURE, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             nTotal += pcoin->GetImmatureCredit();
         }
+        SetCachedBalance(BALANCE_IMMATURE, nTotal);
     }
     return nTotal;
 }
@@ -1384,11 +1444,14 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_WATCH_AVAILABLE, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
+        SetCachedBalance(BALANCE_WATCH_AVAILABLE, nTotal);
     }
 
     return nTotal;
@@ -1399,11 +1462,14 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_WATCH_UNCONFIRMED, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
+        SetCachedBalance(BALANCE_WATCH_UNCONFIRMED, nTotal);
     }
     return nTotal;
 }
@@ -1413,10 +1479,13 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
+        if (GetCachedBalance(BALANCE_WATCH_IMMATURE, nTotal))
+            return nTotal;
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
+        SetCachedBalance(BALANCE_WATCH_IMMATURE, nTotal);
     }
     return nTotal;
 }
@@ -1424,15 +1493,76 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
 /**
  * populate vCoins with vector of available COutputs.
  */
+void CWallet::AddToUnspentIndex(const uint256& wtxid, const CWalletTx& wtx) const
+{
+    if (fUnspentIndexDirty)
+        return;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        isminetype mine = IsMine(wtx.vout[i]);
+        if (mine != ISMINE_NO)
+            mapUnspentIndex[COutPoint(wtxid, i)] = mine;
+    }
+}
+
+void CWallet::SyncUnspentIndex() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Outputs were dropped because of spends in blocks up to pindexUnspentIndex,
+    // if that is no longer in the active chain some of them may be unspent again
+    if (pindexUnspentIndex && !chainActive.Contains(pindexUnspentIndex))
+        fUnspentIndexDirty = true;
+
+    if (fUnspentIndexDirty) {
+        mapUnspentIndex.clear();
+        fUnspentIndexDirty = false;
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            AddToUnspentIndex(it->first, it->second);
+    }
+    pindexUnspentIndex = chainActive.Tip();
+}
+
+/** Spent by a transaction in the active chain, which only a reorg can undo */
+bool CWallet::IsSpentConfirmed(const uint256& hash, unsigned int n) const
+{
+    const COutPoint outpoint(hash, n);
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
+    range = mapTxSpends.equal_range(outpoint);
+
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0)
+            return true;
+    }
+    return false;
+}
+
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl* coinControl, bool fIncludeZeroValue, AvailableCoinsType nCoinType, bool fUseIX) const
 {
     vCoins.clear();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
+        SyncUnspentIndex();
+
+        map<COutPoint, isminetype>::iterator itIndex = mapUnspentIndex.begin();
+        while (itIndex != mapUnspentIndex.end()) {
+            const uint256 wtxid = itIndex->first.hash;
+            // The outputs of one transaction are next to each other in the index
+            map<COutPoint, isminetype>::iterator itEnd = mapUnspentIndex.lower_bound(COutPoint(wtxid, std::numeric_limits<uint32_t>::max()));
+            if (itEnd != mapUnspentIndex.end() && itEnd->first.hash == wtxid)
+                ++itEnd;
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end()) {
+                mapUnspentIndex.erase(itIndex, itEnd);
+                itIndex = itEnd;
+                continue;
+            }
             const CWalletTx* pcoin = &(*it).second;
+            map<COutPoint, isminetype>::iterator itOut = itIndex;
+            itIndex = itEnd;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1453,7 +1583,18 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            while (itOut != itEnd) {
+                unsigned int i = itOut->first.n;
+                isminetype mine = itOut->second;
+                if (IsSpent(wtxid, i)) {
+                    if (IsSpentConfirmed(wtxid, i))
+                        mapUnspentIndex.erase(itOut++);
+                    else
+                        ++itOut;
+                    continue;
+                }
+                ++itOut;
+
                 bool found = false;
                 if (nCoinType == ONLY_DENOMINATED) {
                     found = IsDenominatedAmount(pcoin->vout[i].nValue);
@@ -1470,11 +1611,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 }
                 if (!found) continue;
 
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    (!IsLockedCoin((*it).first, i) || nCoinType == ONLY_SERVICENODE_REQUIRED_AMOUNT) &&
+                if ((!IsLockedCoin(wtxid, i) || nCoinType == ONLY_SERVICENODE_REQUIRED_AMOUNT) &&
                     (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected((*it).first, i)))
+                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(wtxid, i)))
                     vCoins.push_back(COutput(pcoin, i, nDepth,
                         ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
                             (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO)));
@@ -2492,9 +2631,15 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     // presstab HyperStake - Initialize as static and don't update the set on every run of CreateCoinStake() in order to lighten resource use
     static std::set<pair<const CWalletTx*, unsigned int> > setStakeCoins;
     static int nLastStakeSetUpdate = 0;
+    // Kernel inputs of setStakeCoins, recomputed when the coin set, the tip or nBits change
+    static std::vector<pair<const CWalletTx*, unsigned int> > vStakeInputCoins;
+    static std::vector<CStakeKernelInput> vStakeInputs;
+    static uint256 hashStakeInputsTip = 0;
+    static unsigned int nStakeInputsBits = 0;
 
     if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
         setStakeCoins.clear();
+        hashStakeInputsTip = 0;
         if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
             return false;
 
@@ -2513,87 +2658,99 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
-    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
+    unsigned int nMinTime = 0;
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindexTip = chainActive.Tip();
+        if (hashStakeInputsTip != pindexTip->GetBlockHash() || nStakeInputsBits != nBits) {
+            vStakeInputCoins.clear();
+            vStakeInputs.clear();
+            BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
+                BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
+                if (it == mapBlockIndex.end()) {
+                    if (fDebug)
+                        LogPrintf("CreateCoinStake() failed to find block index \n");
+                    continue;
+                }
+
+                CStakeKernelInput input;
+                if (!GetStakeKernelInput(nBits, it->second, COutPoint(pcoin.first->GetHash(), pcoin.second), pcoin.first->vout[pcoin.second].nValue, input)) {
+                    LogPrintf("CreateCoinStake() : failed to get kernel stake modifier \n");
+                    continue;
+                }
+                vStakeInputCoins.push_back(pcoin);
+                vStakeInputs.push_back(input);
+            }
+            hashStakeInputsTip = pindexTip->GetBlockHash();
+            nStakeInputsBits = nBits;
         }
+        // Double check that a kernel will pass time requirements
+        nMinTime = pindexTip->GetMedianTimePast();
+        nHeight = pindexTip->nHeight;
+    }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+    if (vStakeInputs.empty())
+        return false;
 
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+    uint256 hashProofOfStake = 0;
+    nTxNewTime = GetAdjustedTime();
+    int nFound = SearchStakeKernels(vStakeInputs, nTxNewTime, nHashDrift, nMinTime, nTxNewTime, hashProofOfStake);
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+    mapHashedBlocks.clear();
+    mapHashedBlocks[nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
 
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+    if (nFound >= 0) {
+        PAIRTYPE(const CWalletTx*, unsigned int) pcoin = vStakeInputCoins[nFound];
+
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found\n");
+
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            return false;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        const CBlockIndex* pIndex0 = chainActive.Tip();
+        uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -3306,18 +3463,21 @@ bool CWallet::UpdatedTransaction(const uint256& hashTx)
 void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    MarkBalancesDirty();
     setLockedCoins.insert(output);
 }
 
 void CWallet::UnlockCoin(const COutPoint &output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    MarkBalancesDirty();
     setLockedCoins.erase(output);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    MarkBalancesDirty();
     setLockedCoins.clear();
 }
 
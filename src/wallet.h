@@ -25,6 +25,7 @@
 #include "walletdb.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -163,6 +164,52 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs in mapWallet that are ours and not known to be spent by a
+     * confirmed transaction, with their IsMine() type. AvailableCoins() walks
+     * this instead of the whole wallet and drops outputs once their spend
+     * confirms. Rebuilt from mapWallet when keys or watch-only scripts change,
+     * or when a block it relied on for such a spend leaves the active chain.
+     */
+    mutable std::map<COutPoint, isminetype> mapUnspentIndex;
+    mutable bool fUnspentIndexDirty;
+    mutable const CBlockIndex* pindexUnspentIndex;
+
+    void AddToUnspentIndex(const uint256& wtxid, const CWalletTx& wtx) const;
+    void SyncUnspentIndex() const;
+    bool IsSpentConfirmed(const uint256& hash, unsigned int n) const;
+
+    /**
+     * Wallet balance totals, each computed once per state of the wallet, chain
+     * tip and mempool. nBalanceGeneration is bumped by anything that changes a
+     * transaction's credit (MarkDirty), so repeated queries from the GUI, RPC
+     * and the staking loop don't walk mapWallet again. The totals are not
+     * maintained per transaction: the first query after any change still walks
+     * the whole wallet. MarkDirty can run without cs_wallet, hence the atomic.
+     */
+    enum BalanceType {
+        BALANCE_AVAILABLE,
+        BALANCE_UNCONFIRMED,
+        BALANCE_IMMATURE,
+        BALANCE_ANONYMIZABLE,
+        BALANCE_ANONYMIZED,
+        BALANCE_DENOMINATED,
+        BALANCE_DENOMINATED_UNCONFIRMED,
+        BALANCE_WATCH_AVAILABLE,
+        BALANCE_WATCH_UNCONFIRMED,
+        BALANCE_WATCH_IMMATURE,
+        BALANCE_TYPE_COUNT
+    };
+    mutable CAmount nCachedBalance[BALANCE_TYPE_COUNT];
+    mutable bool fCachedBalance[BALANCE_TYPE_COUNT];
+    mutable std::atomic<unsigned int> nBalanceGeneration;
+    mutable unsigned int nCachedBalanceGeneration;
+    mutable unsigned int nCachedBalanceMempool;
+    mutable const CBlockIndex* pindexCachedBalance;
+
+    bool GetCachedBalance(BalanceType type, CAmount& nBalance) const;
+    void SetCachedBalance(BalanceType type, CAmount nBalance) const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, int64_t nTargetAmount) const;
@@ -244,6 +291,14 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
+        fUnspentIndexDirty = true;
+        pindexUnspentIndex = NULL;
+        nBalanceGeneration = 0;
+        nCachedBalanceGeneration = 0;
+        nCachedBalanceMempool = 0;
+        pindexCachedBalance = NULL;
+        for (int i = 0; i < BALANCE_TYPE_COUNT; i++)
+            fCachedBalance[i] = false;
 
         // Stake Settings
         nHashDrift = 45;
@@ -323,7 +378,11 @@ public:
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey& pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey& pubkey)
+    {
+        fUnspentIndexDirty = true;
+        return CCryptoKeyStore::AddKeyPubKey(key, pubkey);
+    }
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& metadata);
 
@@ -380,6 +439,8 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    //! Forget the cached balance totals
+    void MarkBalancesDirty() const { nBalanceGeneration++; }
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
@@ -879,6 +940,8 @@ public:
         fImmatureWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
+        if (pwallet)
+            pwallet->MarkBalancesDirty();
     }
 
     void BindWallet(CWallet* pwalletIn)
@@ -426,9 +426,6 @@ bool storeDataIntoBlockchain(const std::string & rawTx, std::string & txid)
 //*****************************************************************************
 bool unspentP2PKH(std::vector<xbridge::wallet::UtxoEntry> & utxos)
 {
-    vector<COutput> coins;
-    pwalletMain->AvailableCoins(coins, false);
-
     int nMinDepth = 1;
     int nMaxDepth = 9999999;
 
@@ -438,6 +435,12 @@ bool unspentP2PKH(std::vector<xbridge::wallet::UtxoEntry> & utxos)
         utxoUnusable = mempool.mapNextTx;
     }
 
+    // COutput points into the wallet, hold the wallet until the utxos are copied
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    vector<COutput> coins;
+    pwalletMain->AvailableCoins(coins, false);
+
     for (const COutput & out : coins) {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth || !out.fSpendable)
                 continue;
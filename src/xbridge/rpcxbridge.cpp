@@ -268,6 +268,50 @@ Value dxGetOrderFills(const Array & params, bool fHelp)
 //*****************************************************************************
 //*****************************************************************************
 
+static xQuery orderHistoryQuery(const json_spirit::Array& params)
+{
+    return xQuery{
+        params[0].get_str(),    // maker
+        params[1].get_str(),    // taker
+        params[4].get_int(),    // granularity (need before start/end time)
+        params[2].get_int64(),  // start time
+        params[3].get_int64(),  // end time
+        params.size() > 5 && params[5].get_bool()
+            ? xQuery::WithTxids::Included
+            : xQuery::WithTxids::Excluded,
+        params.size() > 6 && params[6].get_bool()
+            ? xQuery::WithInverse::Included
+            : xQuery::WithInverse::Excluded,
+        params.size() > 7
+            ? xQuery::IntervalLimit{params[7].get_int()}
+            : xQuery::IntervalLimit{},
+        params.size() > 8
+            ? xQuery::IntervalTimestamp{params[8].get_str()}
+            : xQuery::IntervalTimestamp{}
+    };
+}
+
+static Array orderHistoryRow(const xQuery& query, const xAggregate& x)
+{
+    const time_duration offset = query.interval_timestamp.at_start()
+        ? query.granularity
+        : boost::posix_time::seconds{0};
+    double volume = x.fromVolume.amount<double>();
+    Array ohlc{
+        ArrayIL{util::iso8601(x.timeEnd - offset), x.low, x.high, x.open, x.close, volume}
+    };
+    if (query.with_txids == xQuery::WithTxids::Included) {
+        Array orderIds{};
+        for (const auto& id : x.orderIds)
+            orderIds.emplace_back(id);
+        ohlc.emplace_back(orderIds);
+    }
+    return ohlc;
+}
+
+//*****************************************************************************
+//*****************************************************************************
+
 Value dxGetOrderHistory(const json_spirit::Array& params, bool fHelp)
 {
     if (fHelp) {
@@ -298,25 +342,7 @@ Value dxGetOrderHistory(const json_spirit::Array& params, bool fHelp)
                                "(limit, default="+std::to_string(xQuery::IntervalLimit{}.count())+")[optional]"
                                "(interval_timestamp, one of [at_start | at_end])[optional] "
                                );
-    const xQuery query{
-        params[0].get_str(),    // maker
-        params[1].get_str(),    // taker
-        params[4].get_int(),    // granularity (need before start/end time)
-        params[2].get_int64(),  // start time
-        params[3].get_int64(),  // end time
-        params.size() > 5 && params[5].get_bool()
-            ? xQuery::WithTxids::Included
-            : xQuery::WithTxids::Excluded,
-        params.size() > 6 && params[6].get_bool()
-            ? xQuery::WithInverse::Included
-            : xQuery::WithInverse::Excluded,
-        params.size() > 7
-            ? xQuery::IntervalLimit{params[7].get_int()}
-            : xQuery::IntervalLimit{},
-        params.size() > 8
-            ? xQuery::IntervalTimestamp{params[8].get_str()}
-            : xQuery::IntervalTimestamp{}
-    };
+    const xQuery query = orderHistoryQuery(params);
 
     if (query.error())
         return util::makeError(xbridge::INVALID_PARAMETERS, __FUNCTION__, query.what() );
@@ -327,22 +353,8 @@ Value dxGetOrderHistory(const json_spirit::Array& params, bool fHelp)
 
         //--Serialize result
         Array arr{};
-        const time_duration offset = query.interval_timestamp.at_start()
-            ? query.granularity
-            : boost::posix_time::seconds{0};
-        for (const auto& x : result) {
-            double volume = x.fromVolume.amount<double>();
-            Array ohlc{
-                ArrayIL{util::iso8601(x.timeEnd - offset), x.low, x.high, x.open, x.close, volume}
-            };
-            if (query.with_txids == xQuery::WithTxids::Included) {
-                Array orderIds{};
-                for (const auto& id : x.orderIds)
-                    orderIds.emplace_back(id);
-                ohlc.emplace_back(orderIds);
-            }
-            arr.emplace_back(ohlc);
-        }
+        for (const auto& x : result)
+            arr.emplace_back(orderHistoryRow(query, x));
         return arr;
     } catch(const std::exception& e) {
         return util::makeError(xbridge::UNKNOWN_ERROR, __FUNCTION__, e.what() );
@@ -351,6 +363,42 @@ Value dxGetOrderHistory(const json_spirit::Array& params, bool fHelp)
     }
 }
 
+/**
+ * @brief dxGetOrderHistory for the chunked HTTP reply, writes the intervals
+ * one at a time instead of building the whole array first
+ */
+void dxGetOrderHistory_stream(const json_spirit::Array& params, CJSONStreamWriter& writer)
+{
+    if (params.size() < 5 || params.size() > 8) {
+        writer.Write(dxGetOrderHistory(params, false));
+        return;
+    }
+
+    const xQuery query = orderHistoryQuery(params);
+
+    if (query.error()) {
+        writer.Write(util::makeError(xbridge::INVALID_PARAMETERS, "dxGetOrderHistory", query.what()));
+        return;
+    }
+
+    std::vector<xAggregate> result;
+    try {
+        auto& xseries = xbridge::App::instance().getXSeriesCache();
+        result = xseries.getXAggregateSeries(query);
+    } catch(const std::exception& e) {
+        writer.Write(util::makeError(xbridge::UNKNOWN_ERROR, "dxGetOrderHistory", e.what()));
+        return;
+    } catch( ... ) {
+        writer.Write(util::makeError(xbridge::UNKNOWN_ERROR, "dxGetOrderHistory", "unknown exception"));
+        return;
+    }
+
+    writer.BeginArray();
+    for (const auto& x : result)
+        writer.Write(orderHistoryRow(query, x));
+    writer.EndArray();
+}
+
 //*****************************************************************************
 //*****************************************************************************
 
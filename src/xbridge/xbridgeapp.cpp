@@ -216,6 +216,7 @@ protected:
     CCriticalSection                                       m_txLocker;
     std::map<uint256, TransactionDescrPtr>             m_transactions;
     std::map<uint256, TransactionDescrPtr>             m_historicTransactions;
+    std::set<uint256>                                  m_acceptingTransactions;
     xSeriesCache                                       m_xSeriesCache;
 
     // network packets queue
@@ -1400,7 +1401,10 @@ xbridge::Error App::sendXBridgeTransaction(const std::string & from,
     boost::posix_time::ptime timestamp = boost::posix_time::microsec_clock::universal_time();
     uint64_t timestampValue = util::timeToInt(timestamp);
 
-    blockHash = chainActive.Tip()->pprev->GetBlockHash();
+    {
+        LOCK(cs_main);
+        blockHash = chainActive.Tip()->pprev->GetBlockHash();
+    }
 
     std::vector<unsigned char> firstUtxoSig = outputsForUse.at(0).signature;
 
@@ -1543,6 +1547,39 @@ bool App::Impl::sendPendingTransaction(const TransactionDescrPtr & ptr)
 Error App::acceptXBridgeTransaction(const uint256     & id,
                                     const std::string & from,
                                     const std::string & to)
+{
+    // dx RPCs run concurrently, don't let two of them take the same order
+    {
+        LOCK(m_p->m_txLocker);
+        if (!m_p->m_acceptingTransactions.insert(id).second)
+        {
+            WARN() << "order " << id.GetHex() << " is already being accepted " << __FUNCTION__;
+            return xbridge::INVALID_STATE;
+        }
+    }
+
+    Error res = xbridge::UNKNOWN_ERROR;
+    try
+    {
+        res = doAcceptXBridgeTransaction(id, from, to);
+    }
+    catch (...)
+    {
+        LOCK(m_p->m_txLocker);
+        m_p->m_acceptingTransactions.erase(id);
+        throw;
+    }
+
+    LOCK(m_p->m_txLocker);
+    m_p->m_acceptingTransactions.erase(id);
+    return res;
+}
+
+//******************************************************************************
+//******************************************************************************
+Error App::doAcceptXBridgeTransaction(const uint256     & id,
+                                      const std::string & from,
+                                      const std::string & to)
 {
     TransactionDescrPtr ptr;
     // TODO checkAcceptPrams can't be used after swap: uncovered bug, fix in progress (due to swap changing to/from)
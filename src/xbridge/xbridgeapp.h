@@ -232,7 +232,8 @@ public:
      * @param id - id of  transaction
      * @param from - destionation address
      * @param to - source address
-     * @return xbridge::SUCCESS, if transaction success accepted
+     * @return xbridge::SUCCESS, if transaction success accepted,
+     * xbridge::INVALID_STATE if the order is already being accepted
      */
     Error acceptXBridgeTransaction(const uint256 & id,
                                      const std::string & from,
@@ -567,6 +568,14 @@ private:
     bool selectUtxos(const std::string &addr, const std::vector<wallet::UtxoEntry> &outputs, const WalletConnectorPtr &connFrom,
                      const uint64_t &requiredAmount, std::vector<wallet::UtxoEntry> &outputsForUse,
                      uint64_t &utxoAmount, uint64_t &fee1, uint64_t &fee2) const;
+
+    /**
+     * @brief doAcceptXBridgeTransaction - acceptXBridgeTransaction body, called
+     * once the order is marked as being accepted
+     */
+    Error doAcceptXBridgeTransaction(const uint256 & id,
+                                     const std::string & from,
+                                     const std::string & to);
 };
 
 } // namespace xbridge
@@ -11,7 +11,7 @@ CZMQAbstractNotifier::~CZMQAbstractNotifier()
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/, const CBlock * /*CBlock*/)
 {
     return true;
 }
@@ -25,3 +25,13 @@ bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transacti
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyXBridgeOrder(const CZMQXBridgeOrder &/*order*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyXBridgeOrderState(const CZMQXBridgeOrder &/*order*/)
+{
+    return true;
+}
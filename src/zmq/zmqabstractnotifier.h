@@ -10,12 +10,23 @@
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** The published fields of an xbridge order, copied while holding the order's lock */
+struct CZMQXBridgeOrder
+{
+    uint256 id;
+    std::string fromCurrency;
+    uint64_t fromAmount;
+    std::string toCurrency;
+    uint64_t toAmount;
+    int32_t state;
+};
+
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), nHighWaterMark(0) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,18 +39,24 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetHighWaterMark() const { return nHighWaterMark; }
+    void SetHighWaterMark(int n) { nHighWaterMark = n; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    // pblock is the block of pindex if the caller has it in memory, or NULL
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    virtual bool NotifyXBridgeOrder(const CZMQXBridgeOrder &order);
+    virtual bool NotifyXBridgeOrderState(const CZMQXBridgeOrder &order);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nHighWaterMark; // ZMQ send high water mark, 0 for the ZMQ default
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -9,13 +9,17 @@
 #include "main.h"
 #include "streams.h"
 #include "util.h"
+#include "xbridge/xbridgeapp.h"
+#include "xbridge/xuiconnector.h"
+
+#include <boost/bind.hpp>
 
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), nMaxQueued(DEFAULT_ZMQ_PUB_QUEUE)
 {
 }
 
@@ -41,6 +45,13 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubxborder"] = CZMQAbstractNotifier::Create<CZMQPublishXBridgeOrderNotifier>;
+    factories["pubxbstate"] = CZMQAbstractNotifier::Create<CZMQPublishXBridgeStateNotifier>;
+
+    int nHighWaterMark = DEFAULT_ZMQ_PUB_HWM;
+    std::map<std::string, std::string>::const_iterator it = args.find("-zmqpubhwm");
+    if (it != args.end())
+        nHighWaterMark = atoi(it->second);
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -52,6 +63,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetHighWaterMark(nHighWaterMark);
             notifiers.push_back(notifier);
         }
     }
@@ -60,6 +72,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     {
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        it = args.find("-zmqpubqueue");
+        if (it != args.end())
+            notificationInterface->nMaxQueued = std::max(atoi(it->second), 1);
 
         if (!notificationInterface->Initialize())
         {
@@ -105,6 +120,11 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    CZMQAbstractPublishNotifier::StartPublisher(nMaxQueued);
+
+    connXBridgeOrder = xuiConnector.NotifyXBridgeTransactionReceived.connect(boost::bind(&CZMQNotificationInterface::NotifyXBridgeOrder, this, _1));
+    connXBridgeOrderChanged = xuiConnector.NotifyXBridgeTransactionChanged.connect(boost::bind(&CZMQNotificationInterface::NotifyXBridgeOrderChanged, this, _1));
+
     return true;
 }
 
@@ -112,8 +132,18 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    connXBridgeOrder.disconnect();
+    connXBridgeOrderChanged.disconnect();
+
+    // xbridge callbacks already under way finish before the sockets close,
+    // later ones see pcontext cleared
+    LOCK(cs_xbridge);
+
     if (pcontext)
     {
+        // no more sends once the sockets start closing
+        CZMQAbstractPublishNotifier::StopPublisher();
+
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -126,17 +156,18 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (notifier->NotifyBlock(pindex, pblock))
         {
             i++;
         }
         else
         {
+            LOCK(cs_xbridge);
             notifier->Shutdown();
             i = notifiers.erase(i);
         }
@@ -154,6 +185,7 @@ void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CB
         }
         else
         {
+            LOCK(cs_xbridge);
             notifier->Shutdown();
             i = notifiers.erase(i);
         }
@@ -171,8 +203,54 @@ void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
         }
         else
         {
+            LOCK(cs_xbridge);
             notifier->Shutdown();
             i = notifiers.erase(i);
         }
     }
 }
+
+// Copy the published fields under the order's lock, which xbridge may hold while it notifies
+static CZMQXBridgeOrder SnapshotXBridgeOrder(xbridge::TransactionDescr &order)
+{
+    LOCK(order._lock);
+    CZMQXBridgeOrder snapshot;
+    snapshot.id = order.id;
+    snapshot.fromCurrency = order.fromCurrency;
+    snapshot.fromAmount = order.fromAmount;
+    snapshot.toCurrency = order.toCurrency;
+    snapshot.toAmount = order.toAmount;
+    snapshot.state = order.state;
+    return snapshot;
+}
+
+void CZMQNotificationInterface::NotifyXBridgeOrder(const xbridge::TransactionDescrPtr &order)
+{
+    CZMQXBridgeOrder snapshot = SnapshotXBridgeOrder(*order);
+
+    LOCK(cs_xbridge);
+    // the sockets are closed once Shutdown has run
+    if (!pcontext)
+        return;
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
+    {
+        (*i)->NotifyXBridgeOrder(snapshot);
+    }
+}
+
+void CZMQNotificationInterface::NotifyXBridgeOrderChanged(const uint256 &id)
+{
+    // look the order up before taking cs_xbridge, xbridge may be holding its own locks
+    xbridge::TransactionDescrPtr order = xbridge::App::instance().transaction(id);
+    if (!order)
+        return;
+    CZMQXBridgeOrder snapshot = SnapshotXBridgeOrder(*order);
+
+    LOCK(cs_xbridge);
+    if (!pcontext)
+        return;
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); ++i)
+    {
+        (*i)->NotifyXBridgeOrderState(snapshot);
+    }
+}
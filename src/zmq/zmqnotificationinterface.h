@@ -5,13 +5,23 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
 
+#include <boost/signals2/connection.hpp>
+#include <boost/shared_ptr.hpp>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+namespace xbridge
+{
+struct TransactionDescr;
+typedef boost::shared_ptr<TransactionDescr> TransactionDescrPtr;
+}
+
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -25,14 +35,24 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void UpdatedBlockTip(const CBlockIndex *pindex, const CBlock *pblock);
     void NotifyTransactionLock(const CTransaction &tx);
 
+    // xuiConnector
+    void NotifyXBridgeOrder(const xbridge::TransactionDescrPtr &order);
+    void NotifyXBridgeOrderChanged(const uint256 &id);
+
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    size_t nMaxQueued; // -zmqpubqueue
+
+    // xbridge events arrive on xbridge threads, apart from the validation callbacks
+    CCriticalSection cs_xbridge;
+    boost::signals2::connection connXBridgeOrder;
+    boost::signals2::connection connXBridgeOrderChanged;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
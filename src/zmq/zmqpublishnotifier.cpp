@@ -8,7 +8,10 @@
 #include "util.h"
 #include "crypto/common.h"
 
+#include <boost/bind.hpp>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
+static CZMQPublishQueue publishQueue;
 
 static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
@@ -16,6 +19,8 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_XBORDER    = "xborder";
+static const char *MSG_XBSTATE    = "xbstate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -57,6 +62,120 @@ static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
     return 0;
 }
 
+void CZMQPublishQueue::Start(size_t nMaxQueuedIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fRunning)
+        return;
+    nMaxQueued = nMaxQueuedIn;
+    fRunning = true;
+    thread = boost::thread(boost::bind(&CZMQPublishQueue::Thread, this));
+}
+
+void CZMQPublishQueue::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning)
+            return;
+        fRunning = false;
+        cond.notify_all();
+    }
+    thread.join();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nDropped += queue.size();
+    queue.clear();
+    if (nDropped)
+        LogPrint("zmq", "zmq: %u notifications dropped\n", nDropped);
+}
+
+bool CZMQPublishQueue::Push(void *psocket, const char *command, const void* data, size_t size, uint32_t nSequence)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning || queue.size() >= nMaxQueued) {
+        nDropped++;
+        LogPrint("zmq", "zmq: Publisher queue full, dropped %s (%u dropped so far)\n", command, nDropped);
+        return false;
+    }
+
+    queue.push_back(Message());
+    Message& msg = queue.back();
+    msg.psocket = psocket;
+    msg.command = command;
+    msg.vchData.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    msg.nSequence = nSequence;
+    cond.notify_one();
+    return true;
+}
+
+void CZMQPublishQueue::Forget(void *psocket)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (std::deque<Message>::iterator it = queue.begin(); it != queue.end(); )
+    {
+        if (it->psocket == psocket)
+        {
+            it = queue.erase(it);
+            nDropped++;
+        }
+        else
+            ++it;
+    }
+    while (psending == psocket)
+        cond.wait(lock);
+}
+
+uint64_t CZMQPublishQueue::GetDropped()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nDropped;
+}
+
+void CZMQPublishQueue::Thread()
+{
+    RenameThread("blocknetdx-zmqpub");
+    Message msg;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            if (!fRunning)
+                return;
+            std::swap(msg, queue.front());
+            queue.pop_front();
+            psending = msg.psocket;
+        }
+
+        /* send three parts, command & data & a LE 4byte sequence number */
+        unsigned char msgseq[sizeof(uint32_t)];
+        WriteLE32(&msgseq[0], msg.nSequence);
+        int rc = zmq_send_multipart(msg.psocket, msg.command, strlen(msg.command), &msg.vchData[0], msg.vchData.size(), msgseq, (size_t)sizeof(uint32_t), (void*)0);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (rc == -1)
+            nDropped++;
+        psending = NULL;
+        cond.notify_all();
+    }
+}
+
+void CZMQAbstractPublishNotifier::StartPublisher(size_t nMaxQueued)
+{
+    publishQueue.Start(nMaxQueued);
+}
+
+void CZMQAbstractPublishNotifier::StopPublisher()
+{
+    publishQueue.Stop();
+}
+
+uint64_t CZMQAbstractPublishNotifier::GetDroppedMessages()
+{
+    return publishQueue.GetDropped();
+}
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
@@ -73,6 +192,13 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
+        if (nHighWaterMark > 0 && zmq_setsockopt(psocket, ZMQ_SNDHWM, &nHighWaterMark, sizeof(nHighWaterMark)) != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
         int rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
@@ -117,6 +243,8 @@ void CZMQAbstractPublishNotifier::Shutdown()
 
     if (count == 1)
     {
+        publishQueue.Forget(psocket);
+
         LogPrint("zmq", "Close socket at address %s\n", address);
         int linger = 0;
         zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
@@ -130,20 +258,16 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
 {
     assert(psocket);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
+    // a full queue is not an error of this notifier, only of its subscribers
+    publishQueue.Push(psocket, command, data, size, nSequence);
 
-    /* increment memory only sequence number after sending */
+    /* increment memory only sequence number after queueing */
     nSequence++;
 
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock * /*pblock*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -173,20 +297,26 @@ bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransa
     return SendMessage(MSG_HASHTXLOCK, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-// XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    if (pblock)
     {
-        LOCK(cs_main);
+        ss << *pblock;
+    }
+    else
+    {
+        // only when several blocks got connected at once
         CBlock block;
-// XX42        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        if(!ReadBlockFromDisk(block, pindex))
         {
-            zmqError("Can't read block from disk");
-            return false;
+            LOCK(cs_main);
+            if(!ReadBlockFromDisk(block, pindex))
+            {
+                zmqError("Can't read block from disk");
+                return false;
+            }
         }
 
         ss << block;
@@ -212,3 +342,28 @@ bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransac
     ss << transaction;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+static void SerializeXBridgeOrder(CDataStream &ss, const CZMQXBridgeOrder &order)
+{
+    char id[32];
+    for (unsigned int i = 0; i < 32; i++)
+        id[31 - i] = order.id.begin()[i];
+    ss.write(id, 32);
+    ss << order.fromCurrency << order.fromAmount << order.toCurrency << order.toAmount << order.state;
+}
+
+bool CZMQPublishXBridgeOrderNotifier::NotifyXBridgeOrder(const CZMQXBridgeOrder &order)
+{
+    LogPrint("zmq", "zmq: Publish xborder %s\n", order.id.GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    SerializeXBridgeOrder(ss, order);
+    return SendMessage(MSG_XBORDER, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishXBridgeStateNotifier::NotifyXBridgeOrderState(const CZMQXBridgeOrder &order)
+{
+    LogPrint("zmq", "zmq: Publish xbstate %s state=%d\n", order.id.GetHex(), order.state);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    SerializeXBridgeOrder(ss, order);
+    return SendMessage(MSG_XBSTATE, &(*ss.begin()), ss.size());
+}
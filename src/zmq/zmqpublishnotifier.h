@@ -7,20 +7,80 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <deque>
+#include <vector>
+
+#include <boost/thread.hpp>
+
 class CBlockIndex;
 
+/** Default for -zmqpubqueue, messages waiting for the publisher thread before new ones are dropped */
+static const unsigned int DEFAULT_ZMQ_PUB_QUEUE = 1000;
+/** Default for -zmqpubhwm, messages ZMQ buffers per subscriber before dropping */
+static const int DEFAULT_ZMQ_PUB_HWM = 1000;
+
+/**
+ * Sends the messages of all publish notifiers on a thread of its own, so a slow
+ * subscriber or a large block does not hold up the validation callbacks.
+ * Messages that find the queue full are dropped and counted.
+ */
+class CZMQPublishQueue
+{
+private:
+    struct Message {
+        void *psocket;
+        const char *command;
+        std::vector<unsigned char> vchData;
+        uint32_t nSequence;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<Message> queue;
+    size_t nMaxQueued;
+    uint64_t nDropped;
+    bool fRunning;
+    void *psending; // socket the thread is sending on
+    boost::thread thread;
+
+    void Thread();
+
+public:
+    CZMQPublishQueue() : nMaxQueued(DEFAULT_ZMQ_PUB_QUEUE), nDropped(0), fRunning(false), psending(NULL) {}
+
+    void Start(size_t nMaxQueuedIn);
+    /** Stop the thread; messages still queued are discarded */
+    void Stop();
+
+    /** Queue a message, returns false if it was dropped */
+    bool Push(void *psocket, const char *command, const void* data, size_t size, uint32_t nSequence);
+    /** Discard the messages queued for psocket and wait until it is not being sent on, before it gets closed */
+    void Forget(void *psocket);
+    /** Messages dropped since startup, because the queue was full or sending failed */
+    uint64_t GetDropped();
+};
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence; // upcounting per message sequence number
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) {}
+
+    /** Start and stop the thread that sends the messages of all publish notifiers */
+    static void StartPublisher(size_t nMaxQueued);
+    static void StopPublisher();
+    /** Messages of all publish notifiers that were not sent */
+    static uint64_t GetDroppedMessages();
+
 
-    /* send zmq multipart message
+    /* queue zmq multipart message for the publisher thread
        parts:
           * command
           * data
           * message sequence number
+       a dropped message still uses up its sequence number, so subscribers see the gap
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
@@ -31,7 +91,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -49,7 +109,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -64,4 +124,23 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+/* xbridge order notifications carry a record of
+     * order id (32 bytes, in the byte order of its hex form)
+     * from currency (string), from amount (uint64)
+     * to currency (string), to amount (uint64)
+     * state (int32, xbridge::TransactionDescr::State)
+   serialized like the P2P protocol does
+*/
+class CZMQPublishXBridgeOrderNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyXBridgeOrder(const CZMQXBridgeOrder &order);
+};
+
+class CZMQPublishXBridgeStateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyXBridgeOrderState(const CZMQXBridgeOrder &order);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H